@@ -79,6 +79,7 @@ else ()
   target_include_directories (SMCE_Boost SYSTEM INTERFACE
       "${boost_SOURCE_DIR}/libs/process/include"
       "${boost_SOURCE_DIR}/libs/interprocess/include"
+      "${boost_SOURCE_DIR}/libs/dll/include" # In-process sketches
       "${boost_SOURCE_DIR}/libs/asio/include" # Dependency of Process
       "${boost_SOURCE_DIR}/libs/algorithm/include" # Dependency of Interprocess
       "${boost_SOURCE_DIR}/libs/range/include" # Dependency of Interprocess
@@ -22,6 +22,7 @@
 # PREPROC_REMOTE_LIBS - whitespace-separated of remote libs to pull for preprocessing
 # COMPLINK_REMOTE_LIBS - remote libs needed at compile/link-time
 # COMPLINK_PATCH_LIBS - remote libs to patch for compile/link-time
+# SKETCH_IN_PROCESS - whether to build the sketch as a shared object for in-process execution
 
 cmake_policy (SET CMP0011 NEW)
 
@@ -133,6 +134,6 @@ endif ()
 
 file (COPY "${SMCE_DIR}/RtResources/SMCE/share/Runtime/CMakeLists.txt" DESTINATION "${COMP_DIR}")
 file (MAKE_DIRECTORY "${COMP_DIR}/build")
-execute_process (COMMAND "${CMAKE_COMMAND}" "-DSMCE_DIR=${SMCE_DIR}" "-DSKETCH_DIR=${SKETCH_DIR}" ${TOOLCHAIN} -S "${COMP_DIR}" -B "${COMP_DIR}/build")
+execute_process (COMMAND "${CMAKE_COMMAND}" "-DSMCE_DIR=${SMCE_DIR}" "-DSKETCH_DIR=${SKETCH_DIR}" "-DSKETCH_IN_PROCESS=${SKETCH_IN_PROCESS}" ${TOOLCHAIN} -S "${COMP_DIR}" -B "${COMP_DIR}/build")
 
 message (STATUS "SMCE: Sketch binary will be at \"${COMP_DIR}/build/Sketch\"")
@@ -102,11 +102,9 @@ int main(int argc, char** argv) {
         std::string buffer;
         while (run) {
             buffer.resize(tx.max_size());
-            const auto len = tx.read(buffer);
-            if (len == 0) {
-                std::this_thread::sleep_for(1ms);
+            if (!tx.wait_readable(100ms)) // wakes up as soon as the sketch writes
                 continue;
-            }
+            const auto len = tx.read(buffer);
             buffer.resize(len);
             std::cout << buffer;
         }
@@ -121,6 +119,8 @@ int main(int argc, char** argv) {
         for (std::span<char> to_write = line; !to_write.empty();) {
             const auto written_count = uart0.rx().write(to_write);
             to_write = to_write.subspan(written_count);
+            if (!to_write.empty())
+                uart0.rx().wait_writable(100ms);
         }
         if (std::cin.eof())
             break;
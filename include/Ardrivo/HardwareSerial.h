@@ -60,6 +60,7 @@ struct SMCE__DLL_RT_API HardwareSerial : Stream {
     [[nodiscard]] int peek() override;
 
     [[nodiscard]] int availableForWrite() override;
+    void flush() override;
 
     size_t write(std::uint8_t) override;
     size_t write(const std::uint8_t*, size_t) override;
@@ -70,6 +71,9 @@ struct SMCE__DLL_RT_API HardwareSerial : Stream {
     using Print::write;
     [[nodiscard]] constexpr /* explicit(false) */ operator bool() noexcept { return true; }
 
+  protected:
+    int timedRead() override;
+
   private:
     friend SMCE_HardwareSerialImpl;
 };
@@ -27,5 +27,6 @@ using SetupSig = void();
 using LoopSig = void();
 
 SMCE__DLL_RT_API int SMCE__main(int, char**, SetupSig*, LoopSig*) noexcept;
+SMCE__DLL_RT_API int SMCE__run_in_process(void*, SetupSig*, LoopSig*) noexcept;
 
 #endif // SMCE_ARDRIVO_SMCE_HPP
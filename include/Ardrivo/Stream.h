@@ -37,6 +37,8 @@ class SMCE__DLL_RT_API Stream : public Print {
 
   protected:
     int peekNextDigit(LookaheadMode lookahead, bool detectDecimal);
+    /// Reads a byte, waiting up to the timeout (in ms of board time) for one to come; -1 if none did
+    virtual int timedRead();
 
   public:
     virtual int available() = 0;
@@ -58,6 +60,7 @@ class SMCE__DLL_RT_API Stream : public Print {
     long parseInt(LookaheadMode lookahead = SKIP_ALL, char ignore = NO_IGNORE_CHAR);
     float parseFloat(LookaheadMode lookahead = SKIP_ALL, char ignore = NO_IGNORE_CHAR);
     void setTimeout(long time);
+    [[nodiscard]] long getTimeout() const noexcept { return _timeout; }
 };
 
 #endif // Stream_h
@@ -19,20 +19,34 @@
 #ifndef SMCE_BOARD_HPP
 #define SMCE_BOARD_HPP
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
-#include <mutex>
 #include <string_view>
 #include <utility>
 #include "SMCE/BoardConf.hpp"
 #include "SMCE/BoardView.hpp"
+#include "SMCE/RuntimeLog.hpp"
 #include "SMCE/SMCE_fs.hpp"
 #include "SMCE/SketchConf.hpp"
 #include "SMCE/fwd.hpp"
 
 namespace smce {
 
+/**
+ * Emulated board, running a sketch
+ *
+ * Sketches built with `SketchConfig::in_process` run on a thread of the host process rather than in their own.
+ * Suspending and stopping those is cooperative, taking effect once the sketch returns from `loop` or sits in `delay`;
+ * one that does not yield within a second of being stopped is abandoned to its thread, as noted in the runtime log.
+ * Their runtime log is not captured (they write to the host's stderr), and a crashing one takes the host down.
+ **/
 class Board {
+    friend BoardFleet;
+    friend BoardPool;
+
   public:
     // clang-format off
     enum class Status {
@@ -44,7 +58,17 @@ class Board {
     };
     // clang-format on
 
-    using LockedLog = std::pair<std::unique_lock<std::mutex>, std::string&>;
+    struct Stats {
+        std::chrono::nanoseconds cpu_user{};    /// CPU time spent by the sketch in user mode
+        std::chrono::nanoseconds cpu_system{};  /// CPU time spent by the kernel on behalf of the sketch
+        std::uint64_t rss = 0;                  /// Resident memory of the sketch process, in bytes
+        std::uint64_t voluntary_switches = 0;   /// Context switches of the sketch due to it blocking
+        std::uint64_t involuntary_switches = 0; /// Context switches of the sketch due to preemption
+        std::size_t shm_size = 0;               /// Size of the segment holding the board data, in bytes
+        std::size_t shm_used = 0;               /// Bytes in use within that segment
+        std::uint64_t log_bytes = 0;            /// Bytes written to the runtime log
+        std::chrono::nanoseconds uptime{};      /// Time since the sketch was started
+    };
 
     /**
      * Constructor
@@ -67,7 +91,27 @@ class Board {
     /// Getter for the attached sketch
     [[nodiscard]] const Sketch* get_sketch() const noexcept { return m_sketch_ptr; }
 
-    /// Tick runner; call in your frontend physics loop
+    /**
+     * Attaches a pool of pre-spawned sketches to draw from on `start`
+     * \param pool - the pool to use, or `nullptr` to detach the current one
+     * \return whether the operation succeeded or not
+     * \note The pool is only used if its sketch and configuration match the board's
+     **/
+    bool attach_pool(BoardPool* pool) noexcept;
+
+    /**
+     * Attaches a fork-server to spawn the sketch from on `start`
+     * \param fork_server - the fork-server to use, or `nullptr` to detach the current one
+     * \return whether the operation succeeded or not
+     * \note The fork-server is only used if it serves the board's sketch and is valid
+     **/
+    bool attach_fork_server(ForkServer* fork_server) noexcept;
+
+    /**
+     * Tick runner; call in your frontend physics loop
+     * \note On Linux, sketch exits are detected and logs drained by a shared reactor thread (pidfd & epoll),
+     *       leaving `tick` to check a flag instead of polling the sketch process
+     **/
     void tick() noexcept;
 
     bool reset() noexcept;
@@ -78,23 +122,38 @@ class Board {
     bool terminate() noexcept;
     bool stop() noexcept;
 
-    [[nodiscard]] inline LockedLog runtime_log() noexcept {
-        return {std::unique_lock{m_runtime_log_mtx}, m_runtime_log};
-    }
+    /// Runtime log of the sketch (its stderr); bounded, and kept across restarts until `reset`
+    [[nodiscard]] RuntimeLog& runtime_log() noexcept { return m_runtime_log; }
+
+    /**
+     * Samples the resource usage of the sketch
+     * \note Only `log_bytes` is set unless the sketch is running or suspended.
+     *       CPU time, resident memory and context switches are sampled from procfs, thus only set on Linux;
+     *       for in-process sketches they are those of the sketch's thread, and the resident memory is not set.
+     **/
+    [[nodiscard]] Stats stats() noexcept;
 
   private:
     struct Internal;
     enum class Command;
 
-    void do_spawn() noexcept;
-    void do_sweep() noexcept;
+    static bool do_prespawn(Internal&, const Sketch&, const BoardConfig&, ForkServer*) noexcept;
+    static bool do_load(Internal&, const Sketch&, const BoardConfig&) noexcept;
+    static void do_unload(Internal&) noexcept;
+    bool do_spawn() noexcept;
+    void do_release() noexcept;
+    bool do_watch_log() noexcept;
+    void do_unwatch_log() noexcept;
+    int do_sweep() noexcept;
     void do_reap() noexcept;
 
     Status m_status{};
     std::optional<BoardConfig> m_conf_opt;
     const Sketch* m_sketch_ptr = nullptr;
-    std::string m_runtime_log;
-    std::mutex m_runtime_log_mtx;
+    BoardPool* m_pool = nullptr;
+    ForkServer* m_fork_server = nullptr;
+    Reactor* m_reactor = nullptr; // set by fleets; boards use the shared reactor otherwise
+    RuntimeLog m_runtime_log;
     std::function<void(int)> m_exit_notify;
     std::unique_ptr<Internal> m_internal;
 };
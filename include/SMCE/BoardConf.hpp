@@ -34,23 +34,36 @@ struct BoardConfig {
         struct DigitalDriver {
             bool board_read;
             bool board_write;
+            bool operator==(const DigitalDriver&) const = default;
         };
         struct AnalogDriver {
             bool board_read;
             bool board_write;
             // std::size_t width;
+            bool operator==(const AnalogDriver&) const = default;
         };
         std::uint16_t pin_id{};
         std::optional<DigitalDriver> digital_driver;
         std::optional<AnalogDriver> analog_driver;
+        bool operator==(const GpioDrivers&) const = default;
     };
     struct UartChannel {
         std::optional<std::uint16_t> rx_pin_override;
         std::optional<std::uint16_t> tx_pin_override;
-        std::uint16_t baud_rate = 9600;
+        std::uint32_t baud_rate = 9600;
         std::size_t rx_buffer_length = 64;
         std::size_t tx_buffer_length = 64;
+        /// Bytes written by the sketch are staged until this many are pending (at most `tx_buffer_length`); 0 to not
         std::size_t flushing_threshold = 0;
+        /**
+         * Whether bytes only get through to the other side as fast as the baud rate allows (8N1), in board time
+         * \note Off runs the channel at maximum speed, e.g. for throughput runs; see `VirtualUart::set_paced`
+         **/
+        bool paced = false;
+        /// Leaves room in the buffers for a `UartRecorder` to trail behind their readers, doubling their memory;
+        /// a board can only be recorded if all its channels are
+        bool recordable = false;
+        bool operator==(const UartChannel&) const = default;
     };
     /*
     struct I2cBus {
@@ -61,6 +74,7 @@ struct BoardConfig {
     struct SecureDigitalStorage {
         std::uint16_t cspin = 0; /// SPI Chip-Select pin; default one opened is 0
         stdfs::path root_dir;    /// Path to root directory
+        bool operator==(const SecureDigitalStorage&) const = default;
     };
 
     struct FrameBuffer {
@@ -73,6 +87,17 @@ struct BoardConfig {
         // clang-format on
         std::size_t key;
         Direction direction;
+        std::uint16_t max_width = 640;  /// Largest width the frame-buffer is expected to take, in px
+        std::uint16_t max_height = 480; /// Largest height the frame-buffer is expected to take, in px
+        bool operator==(const FrameBuffer&) const = default;
+    };
+
+    /// Backing of the memory shared with the sketch
+    struct SharedSegment {
+        bool anonymous = false;  /// Anonymous memory file (memfd) handed down to the sketch, instead of a named object
+        bool huge_pages = false; /// Back an anonymous segment with huge pages, if any are reserved on the system
+        bool prefault = false;   /// Fault all pages of the segment in upfront, on the host and sketch sides
+        bool operator==(const SharedSegment&) const = default;
     };
 
     std::vector<std::uint16_t> pins;        /// GPIO pins
@@ -81,6 +106,23 @@ struct BoardConfig {
     // std::vector<I2cBus> i2c_buses;
     std::vector<SecureDigitalStorage> sd_cards;
     std::vector<FrameBuffer> frame_buffers; /// Frame-buffers (cameras & screens)
+    /**
+     * Speed of board time relative to wall time, as seen by `millis`, `micros` and `delay`
+     * \note A factor of 0 stops board time, which then only moves through `VirtualClock::advance`
+     **/
+    double clock_speed_factor = 1.0;
+    /**
+     * Number of pin changes (by `digitalWrite` and `analogWrite`) queued until drained through `VirtualPinEvents`
+     * \note 0 disables the queue; further changes are dropped while it is full
+     * \note Clamped to `max_pin_event_capacity`
+     **/
+    std::size_t pin_event_capacity = 0;
+    /// Largest capacity of the queue of pin changes
+    static constexpr std::size_t max_pin_event_capacity = 0xFFFF;
+    /// \note Anonymous segments are only supported on Linux; elsewhere, named ones are used regardless
+    SharedSegment shared_segment;
+
+    bool operator==(const BoardConfig&) const = default;
 };
 
 } // namespace smce
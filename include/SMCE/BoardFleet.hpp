@@ -0,0 +1,107 @@
+/*
+ *  BoardFleet.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_BOARDFLEET_HPP
+#define SMCE_BOARDFLEET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "SMCE/Board.hpp"
+#include "SMCE/fwd.hpp"
+
+namespace smce {
+
+/**
+ * Fleet of boards, driven in bulk.
+ *
+ * The fleet owns its boards and multiplexes the exits and runtime logs of all of their sketches
+ * through a reactor (epoll loop) of its own rather than the one shared by all other boards,
+ * so that one host process can run thousands of sketches without fleets contending with each other.
+ * \note The reactor is only available on Linux; elsewhere the boards manage their sketches on their own.
+ **/
+class BoardFleet {
+  public:
+    struct Stats {
+        std::size_t boards = 0;      /// Boards in the fleet
+        std::size_t running = 0;     /// Boards with a running sketch
+        std::size_t suspended = 0;   /// Boards with a suspended sketch
+        std::size_t stopped = 0;     /// Boards whose sketch stopped or exited
+        std::uint64_t exits = 0;     /// Unexpected sketch exits seen by `tick`
+        std::uint64_t log_bytes = 0; /// Bytes written to the runtime logs of all boards
+    };
+
+    /**
+     * Constructor
+     * \param exit_notify - optional notification handler of a sketch's unexpected exit,
+     *                      given the index of its board and its exit code; called by `tick`
+     **/
+    explicit BoardFleet(std::function<void(std::size_t, int)> exit_notify = nullptr) noexcept;
+    ~BoardFleet();
+
+    BoardFleet(const BoardFleet&) = delete;
+    BoardFleet& operator=(const BoardFleet&) = delete;
+
+    /**
+     * Adds boards to the fleet
+     * \param count - number of boards to add
+     * \return index of the first added board
+     **/
+    std::size_t add(std::size_t count = 1);
+
+    /// Number of boards in the fleet
+    [[nodiscard]] std::size_t size() const noexcept { return m_boards.size(); }
+    /// Board accessor
+    [[nodiscard]] Board& operator[](std::size_t idx) noexcept { return *m_boards[idx]; }
+
+    /// Attaches a sketch to all boards; returns the number of boards on which this succeeded
+    std::size_t attach_sketch(const Sketch& sketch) noexcept;
+    /// Configures all boards; returns the number of boards on which this succeeded
+    std::size_t configure(const BoardConfig& bconf) noexcept;
+    /// Starts all boards; returns the number of boards on which this succeeded
+    std::size_t start() noexcept;
+    /// Suspends all boards; returns the number of boards on which this succeeded
+    std::size_t suspend() noexcept;
+    /// Resumes all boards; returns the number of boards on which this succeeded
+    std::size_t resume() noexcept;
+    /// Stops all boards; returns the number of boards on which this succeeded
+    std::size_t stop() noexcept;
+    /// Resets all boards; returns the number of boards on which this succeeded
+    std::size_t reset() noexcept;
+
+    /// Ticks all boards; call in your frontend physics loop
+    void tick() noexcept;
+
+    /// Aggregate statistics of the fleet
+    [[nodiscard]] Stats stats() noexcept;
+
+  private:
+    template <class F>
+    std::size_t for_each_board(F f) noexcept;
+
+    std::function<void(std::size_t, int)> m_exit_notify;
+    std::unique_ptr<Reactor> m_reactor;
+    std::vector<std::unique_ptr<Board>> m_boards;
+    std::uint64_t m_exits = 0;
+};
+
+} // namespace smce
+
+#endif // SMCE_BOARDFLEET_HPP
@@ -0,0 +1,106 @@
+/*
+ *  BoardPool.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_BOARDPOOL_HPP
+#define SMCE_BOARDPOOL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SMCE/Board.hpp"
+#include "SMCE/BoardConf.hpp"
+#include "SMCE/fwd.hpp"
+
+namespace smce {
+
+/**
+ * Pool of pre-spawned sketches, handed out to boards on `Board::start`.
+ *
+ * Each pooled sketch already has its shared segment configured and its process spawned,
+ * but is parked before its `setup()` until a board takes it over.
+ * The pool refills itself in the background after each hand-out.
+ **/
+class BoardPool {
+    friend Board;
+
+  public:
+    struct Metrics {
+        std::uint64_t hits = 0;                         /// Starts served by a pre-spawned sketch
+        std::uint64_t misses = 0;                       /// Starts which had to spawn a sketch themselves
+        std::chrono::nanoseconds last_start_latency{};  /// Latency of the last `Board::start`
+        std::chrono::nanoseconds max_start_latency{};   /// Highest latency of a `Board::start`
+        std::chrono::nanoseconds total_start_latency{}; /// Sum of the latencies of all `Board::start`
+    };
+
+    /**
+     * Constructor; starts warming up the pool in the background
+     * \param sketch - the sketch to pre-spawn; must be compiled, and outlive the pool
+     * \param bconf - the board configuration to pre-configure the segments with
+     * \param capacity - number of pre-spawned sketches to keep ready
+     * \param fork_server - optional fork-server of the sketch to spawn from
+     **/
+    BoardPool(const Sketch& sketch, BoardConfig bconf, std::size_t capacity,
+              ForkServer* fork_server = nullptr) noexcept;
+    ~BoardPool();
+
+    BoardPool(const BoardPool&) = delete;
+    BoardPool& operator=(const BoardPool&) = delete;
+
+    /// Getter for the pooled sketch
+    [[nodiscard]] const Sketch& sketch() const noexcept { return m_sketch; }
+    /// Getter for the pooled board configuration
+    [[nodiscard]] const BoardConfig& config() const noexcept { return m_bconf; }
+    /// Getter for the number of pre-spawned sketches to keep ready
+    [[nodiscard]] std::size_t capacity() const noexcept { return m_capacity; }
+    /// Number of pre-spawned sketches currently ready
+    [[nodiscard]] std::size_t available() noexcept;
+    /// Snapshot of the pool metrics
+    [[nodiscard]] Metrics metrics() noexcept;
+
+    /**
+     * Blocks until the pool is full
+     * \return whether the pool got filled (false if spawning failed)
+     **/
+    bool warm_up() noexcept;
+
+  private:
+    bool take(Board& board) noexcept;
+    void record_start(bool hit, std::chrono::nanoseconds latency) noexcept;
+    void fill() noexcept;
+
+    const Sketch& m_sketch;
+    BoardConfig m_bconf;
+    std::size_t m_capacity;
+    ForkServer* m_fork_server;
+    std::vector<std::unique_ptr<Board::Internal>> m_ready;
+    Metrics m_metrics;
+    bool m_failing = false;
+    bool m_quit = false;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::thread m_filler;
+};
+
+} // namespace smce
+
+#endif // SMCE_BOARDPOOL_HPP
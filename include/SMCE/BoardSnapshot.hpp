@@ -0,0 +1,82 @@
+/*
+ *  BoardSnapshot.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_BOARDSNAPSHOT_HPP
+#define SMCE_BOARDSNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "SMCE/fwd.hpp"
+
+namespace smce {
+
+/**
+ * Compact binary capture of the state of a board
+ *
+ * Holds the value, direction and active driver of every pin, the contents of every UART buffer,
+ * and the metadata (dimensions, frequency, transform) of every frame-buffer; board time and frame-buffer
+ * pixels are left out. The layout only depends on the board's configuration: two snapshots of the same
+ * board always have the same size, which keeps diffing them down to a byte comparison.
+ * \note Encoded in host byte order; not meant to be persisted nor sent across machines.
+ **/
+class BoardSnapshot {
+  public:
+    /**
+     * Delta between two snapshots
+     *
+     * Encodes the size of the target snapshot, followed by runs of changed bytes
+     * (each an offset and a length, then the bytes themselves).
+     **/
+    struct Diff {
+        std::vector<std::byte> bytes;
+        /// Whether the two snapshots were identical
+        [[nodiscard]] bool empty() const noexcept { return bytes.size() <= sizeof(std::uint32_t); }
+    };
+
+    BoardSnapshot() noexcept = default;
+
+    /**
+     * Captures the current state of a board
+     * \param view - view of the board; an empty snapshot is returned if invalid
+     **/
+    [[nodiscard]] static BoardSnapshot capture(BoardView view);
+
+    /// Encoded bytes of the snapshot
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return m_bytes; }
+    /// Whether the snapshot holds any state
+    [[nodiscard]] bool empty() const noexcept { return m_bytes.empty(); }
+
+    /// Computes the delta turning `from` into this snapshot
+    [[nodiscard]] Diff diff_from(const BoardSnapshot& from) const;
+    /**
+     * Applies a delta to this snapshot
+     * \return false if the delta is malformed, in which case the snapshot is left unmodified
+     **/
+    bool apply(const Diff& diff);
+
+    [[nodiscard]] bool operator==(const BoardSnapshot&) const noexcept = default;
+
+  private:
+    std::vector<std::byte> m_bytes;
+};
+
+} // namespace smce
+
+#endif // SMCE_BOARDSNAPSHOT_HPP
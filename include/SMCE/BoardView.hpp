@@ -19,6 +19,7 @@
 #ifndef SMCE_BOARDVIEW_HPP
 #define SMCE_BOARDVIEW_HPP
 
+#include <chrono>
 #include <cstdint>
 #include <span>
 #include <string_view>
@@ -82,6 +83,19 @@ class VirtualPin {
     [[nodiscard]] VirtualAnalogDriver analog() noexcept { return {m_bdat, m_idx}; }
 };
 
+/// State of a pin, as read in bulk
+struct PinState {
+    std::uint16_t id;                    /// Id of the pin
+    std::uint16_t value;                 /// Raw value; non-zero when digitally high
+    VirtualPin::DataDirection direction; /// Data direction; `in` when locked
+};
+
+/// Change of the value of a pin, as written in bulk
+struct PinWrite {
+    std::uint16_t id;    /// Id of the pin
+    std::uint16_t value; /// Raw value; 255 for digitally high
+};
+
 class VirtualPins {
     friend BoardView;
     BoardData* m_bdat;
@@ -93,7 +107,56 @@ class VirtualPins {
     [[nodiscard]] VirtualPin operator[](std::size_t idx) noexcept;
     // [[nodiscard]] Iterator begin() noexcept;
     // [[nodiscard]] Iterator end() noexcept;
-    // [[nodiscard]] std::size_t size() noexcept;
+    /// Number of pins
+    [[nodiscard]] std::size_t size() noexcept;
+
+    /**
+     * Reads the state of all pins in a single pass, by increasing id
+     * \return number of pins read; at most the size of the span
+     **/
+    std::size_t read(std::span<PinState>) noexcept;
+    /**
+     * Writes the values of several pins in a single call
+     * \return number of writes applied; those to pins that do not exist are skipped
+     **/
+    std::size_t write(std::span<const PinWrite>) noexcept;
+};
+
+/// Change of the value of a pin, made by the sketch
+struct PinEvent {
+    std::chrono::nanoseconds time; /// Board time of the change
+    std::uint16_t pin;             /// Id of the pin
+    std::uint16_t value;           /// New value; 0 or 255 when written digitally
+};
+
+/**
+ * Queue of the changes made by the sketch to the values of its pins, in order
+ *
+ * Lets hosts process the changes as they happen instead of polling every pin.
+ * \note Only filled when enabled by `BoardConfig::pin_event_capacity`
+ **/
+class VirtualPinEvents {
+    friend BoardView;
+    BoardData* m_bdat;
+    constexpr explicit VirtualPinEvents(BoardData* bdat) noexcept : m_bdat{bdat} {}
+
+  public:
+    /// Object validity check; false if the queue is disabled
+    [[nodiscard]] bool exists() noexcept;
+    /// Number of queued events
+    [[nodiscard]] std::size_t size() noexcept;
+    /// Number of changes dropped as the queue was full; the values of the pins are then to be read anew
+    [[nodiscard]] std::uint64_t dropped() noexcept;
+    /// Dequeues events, oldest first
+    std::size_t read(std::span<PinEvent>) noexcept; // Host-only
+    /**
+     * Blocks until there are events to read, without spinning
+     * \param timeout - maximum time to block for
+     * \return whether there are events to read
+     **/
+    bool wait(std::chrono::nanoseconds timeout) noexcept; // Host-only
+    /// Queues a change of value of a pin, at the current board time
+    void push(std::uint16_t pin_id, std::uint16_t value) noexcept; // Sketch-only
 };
 
 class VirtualUartBuffer {
@@ -108,6 +171,14 @@ class VirtualUartBuffer {
         : m_bdat{bdat}, m_index{idx}, m_dir{dir} {}
 
   public:
+    /// Bytes of the buffer, in place; split in two where they wrap around the end of the ring
+    template <class Char>
+    struct Spans {
+        std::span<Char> first;  /// Bytes up to the end of the ring
+        std::span<Char> second; /// Bytes wrapped around to the start of the ring
+        [[nodiscard]] std::size_t size() const noexcept { return first.size() + second.size(); }
+    };
+
     /// Object validity check
     [[nodiscard]] bool exists() noexcept;
     [[nodiscard]] std::size_t max_size() noexcept;
@@ -115,6 +186,32 @@ class VirtualUartBuffer {
     std::size_t read(std::span<char>) noexcept;
     std::size_t write(std::span<const char>) noexcept;
     [[nodiscard]] char front() noexcept;
+    /**
+     * Acquires the bytes to read, in place in shared memory, without copying them
+     * \note Reader only (the sketch for rx, the host for tx); they remain queued until `commit_read`
+     **/
+    [[nodiscard]] Spans<const char> acquire_read() noexcept;
+    /// Dequeues bytes read in place, at most as many as were acquired
+    void commit_read(std::size_t count) noexcept;
+    /**
+     * Acquires the room left to write, in place in shared memory
+     * \note Writer only (the host for rx, the sketch for tx); bytes are only queued once passed to `commit_write`
+     **/
+    [[nodiscard]] Spans<char> acquire_write() noexcept;
+    /// Queues bytes written in place, at most as many as room was acquired for
+    void commit_write(std::size_t count) noexcept;
+    /**
+     * Blocks until there are bytes to read, without spinning
+     * \param timeout - maximum time to block for
+     * \return whether there are bytes to read
+     **/
+    bool wait_readable(std::chrono::nanoseconds timeout) noexcept;
+    /**
+     * Blocks until there is room to write, without spinning
+     * \param timeout - maximum time to block for
+     * \return whether there is room to write
+     **/
+    bool wait_writable(std::chrono::nanoseconds timeout) noexcept;
 };
 
 class VirtualUart {
@@ -128,6 +225,12 @@ class VirtualUart {
     [[nodiscard]] bool exists() noexcept;
     [[nodiscard]] bool is_active() noexcept;
     void set_active(bool) noexcept; // Board-only
+    /// Whether bytes only get through as fast as the baud rate of the channel allows, in board time
+    [[nodiscard]] bool is_paced() noexcept;
+    /// Switches pacing on or off; off runs the channel at maximum speed
+    void set_paced(bool) noexcept;
+    /// Number of bytes the sketch stages before writing them to tx; 0 if it writes through
+    [[nodiscard]] std::size_t flushing_threshold() noexcept;
     VirtualUartBuffer rx() noexcept { return {m_bdat, m_index, VirtualUartBuffer::Direction::rx}; }
     VirtualUartBuffer tx() noexcept { return {m_bdat, m_index, VirtualUartBuffer::Direction::tx}; }
 };
@@ -187,11 +290,19 @@ class FrameBuffer {
 
     /// \note Size in px
     [[nodiscard]] std::uint16_t get_width() noexcept;
-    /// \note Size in px
+    /**
+     * \note Size in px
+     * \note Left unchanged if the board has no memory left for the resulting frame;
+     *       room is only guaranteed up to the configured maximum resolution
+     **/
     void set_width(std::uint16_t) noexcept;
     /// \note Size in px
     [[nodiscard]] std::uint16_t get_height() noexcept;
-    /// \note Size in px
+    /**
+     * \note Size in px
+     * \note Left unchanged if the board has no memory left for the resulting frame;
+     *       room is only guaranteed up to the configured maximum resolution
+     **/
     void set_height(std::uint16_t) noexcept;
 
     /// \note Frequency is in Hz
@@ -199,6 +310,9 @@ class FrameBuffer {
     /// \note Frequency is in Hz
     void set_freq(std::uint8_t) noexcept;
 
+    /// Number of frames written so far, wrapping around; changes whenever a frame gets written
+    [[nodiscard]] std::uint32_t frame_count() noexcept;
+
     /// Copies a frame from an RGB888 buffer
     bool write_rgb888(std::span<const std::byte>);
     /// Copies a frame into an RGB888 buffer
@@ -222,11 +336,46 @@ class FrameBuffers {
     [[nodiscard]] FrameBuffer operator[](std::size_t) noexcept;
 };
 
+/**
+ * Board time, shared by the host and the sketch
+ *
+ * Board time runs at a speed factor relative to wall time, or is stepped by the host when that factor is 0.
+ **/
+class VirtualClock {
+    friend BoardView;
+    BoardData* m_bdat;
+    constexpr explicit VirtualClock(BoardData* bdat) noexcept : m_bdat{bdat} {}
+
+  public:
+    /// Object validity check
+    [[nodiscard]] bool exists() noexcept;
+    /// Board time elapsed since the sketch started
+    [[nodiscard]] std::chrono::nanoseconds now() noexcept;
+    /// Speed of board time relative to wall time; 0 if stepped
+    [[nodiscard]] double speed_factor() noexcept;
+    /// Changes the speed of board time from now on; negative factors are ignored
+    void set_speed_factor(double) noexcept;
+    /// Moves board time forward, waking up the sketch if waiting on it
+    void advance(std::chrono::nanoseconds) noexcept;
+    /// Restarts board time from zero
+    void reset() noexcept;
+    /**
+     * Blocks until board time reaches a deadline
+     * \param deadline - board time to wait for
+     * \param max_wait - wall time after which to give up; only checked on clock updates when stepped
+     * \return whether the deadline was reached
+     **/
+    bool wait_until(std::chrono::nanoseconds deadline,
+                    std::chrono::nanoseconds max_wait = std::chrono::nanoseconds::max()) noexcept;
+};
+
 /**
  * Mutable view of the virtual board.
  * \note Must stay a no-fail interface (operations all silently fail on error and never cause UB)
  **/
 class BoardView {
+    friend BoardSnapshot;
+    friend UartRecorder;
     BoardData* m_bdat{};
 
   public:
@@ -238,11 +387,13 @@ class BoardView {
     };
     // clang-format on
 
-    VirtualPins pins{m_bdat};           /// GPIO pins
-    VirtualUarts uart_channels{m_bdat}; /// UART channels
+    VirtualPins pins{m_bdat};            /// GPIO pins
+    VirtualPinEvents pin_events{m_bdat}; /// Changes of the pins made by the sketch
+    VirtualUarts uart_channels{m_bdat};  /// UART channels
     // VirtualI2cs i2c_buses;
     // VirtualOpaqueDevices opaque_devices;
-    FrameBuffers frame_buffers{m_bdat}; /// Camera/Screen frame-buffers
+    FrameBuffers frame_buffers{m_bdat};  /// Camera/Screen frame-buffers
+    VirtualClock clock{m_bdat};          /// Board time
 
     constexpr BoardView() noexcept = default;
     explicit BoardView(BoardData& bdat) : m_bdat{&bdat} {}
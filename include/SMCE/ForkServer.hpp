@@ -0,0 +1,81 @@
+/*
+ *  ForkServer.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_FORKSERVER_HPP
+#define SMCE_FORKSERVER_HPP
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include "SMCE/fwd.hpp"
+
+namespace smce {
+
+/**
+ * Fork-server (zygote) for a compiled sketch.
+ *
+ * Keeps one process of the sketch executable around which has already been dynamically linked
+ * against Ardrivo and ran its static initializers; boards using it get their sketch forked off
+ * that process instead of executing the binary anew.
+ *
+ * \note Only supported on Linux; `valid()` is always false elsewhere and boards fall back to
+ *       spawning their sketch normally.
+ * \warning Makes the host process a child subreaper (`PR_SET_CHILD_SUBREAPER`) while a sketch gets forked,
+ *          so that it can be waited on like a regular child; other descendants of the host orphaned meanwhile get
+ *          adopted too. The attribute is cleared afterwards, unless the host had set it on its own.
+ **/
+class ForkServer {
+    friend Board;
+
+  public:
+    /**
+     * Constructor; launches the zygote
+     * \param sketch - the sketch to serve; must be compiled, and outlive the fork-server
+     **/
+    explicit ForkServer(const Sketch& sketch) noexcept;
+    ~ForkServer();
+
+    ForkServer(const ForkServer&) = delete;
+    ForkServer& operator=(const ForkServer&) = delete;
+
+    /// Getter for the served sketch
+    [[nodiscard]] const Sketch& sketch() const noexcept { return m_sketch; }
+    /// Whether the zygote is up and accepting requests
+    [[nodiscard]] bool valid() noexcept;
+
+  private:
+    struct Internal;
+
+    /**
+     * Forks a parked sketch off the zygote
+     * \param segname - name of the shared segment of the board
+     * \param stdin_fd - file descriptor to use as the sketch's stdin (its gate)
+     * \param stderr_fd - file descriptor to use as the sketch's stderr (its log)
+     * \param seg_fd - memory file of the shared segment of the board if anonymous, otherwise -1
+     * \return the pid of the new sketch, or -1 on failure
+     **/
+    int fork(std::string_view segname, int stdin_fd, int stderr_fd, int seg_fd = -1) noexcept;
+
+    const Sketch& m_sketch;
+    std::mutex m_mtx;
+    std::unique_ptr<Internal> m_internal;
+};
+
+} // namespace smce
+
+#endif // SMCE_FORKSERVER_HPP
@@ -0,0 +1,94 @@
+/*
+ *  RuntimeLog.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_RUNTIMELOG_HPP
+#define SMCE_RUNTIMELOG_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace smce {
+
+/**
+ * Bounded runtime log of a sketch (its stderr)
+ *
+ * Every byte ever written is numbered by its position in the stream, starting at 0;
+ * only the last `capacity()` of them are retained, older ones get overwritten.
+ * Readers keep a cursor (the sequence number they read up to) and obtain everything written since
+ * as spans into the ring, without copying nor locking; as the writer may overwrite those spans meanwhile,
+ * readers check that a chunk is still `intact` once done with it.
+ * \note Written to by a single thread (the one draining the sketch's stderr)
+ **/
+class RuntimeLog {
+  public:
+    struct Chunk {
+        std::uint64_t begin = 0;      /// Sequence number of the first byte of the chunk
+        std::uint64_t end = 0;        /// Sequence number past the last byte of the chunk; cursor to read from next
+        std::span<const char> first;  /// Bytes of the chunk up to the end of the ring
+        std::span<const char> second; /// Bytes of the chunk wrapped around to the start of the ring
+        [[nodiscard]] std::size_t size() const noexcept { return static_cast<std::size_t>(end - begin); }
+    };
+
+    static constexpr std::size_t default_capacity = 64 * 1024;
+
+    /**
+     * Constructor
+     * \param capacity - number of bytes to retain; rounded up to a power of two
+     **/
+    explicit RuntimeLog(std::size_t capacity = default_capacity);
+
+    RuntimeLog(const RuntimeLog&) = delete;
+    RuntimeLog& operator=(const RuntimeLog&) = delete;
+
+    /// Number of bytes retained
+    [[nodiscard]] std::size_t capacity() const noexcept { return m_capacity; }
+    /// Sequence number of the oldest retained byte
+    [[nodiscard]] std::uint64_t begin() const noexcept;
+    /// Sequence number past the newest byte; the total number of bytes ever written
+    [[nodiscard]] std::uint64_t end() const noexcept { return m_end.load(std::memory_order_acquire); }
+
+    /**
+     * Reads everything written since a cursor, without copying
+     * \param cursor - sequence number to read from; bytes no longer retained are skipped
+     **/
+    [[nodiscard]] Chunk read(std::uint64_t cursor) const noexcept;
+    /// Whether the bytes of a chunk have not been overwritten since it was read
+    [[nodiscard]] bool intact(const Chunk& chunk) const noexcept;
+    /// Copies everything retained since a cursor
+    [[nodiscard]] std::string copy(std::uint64_t cursor = 0) const;
+
+    /// Appends bytes, overwriting the oldest ones when full
+    void write(std::span<const char> bytes) noexcept;
+    /// Drops all retained bytes; sequence numbers keep on increasing
+    void clear() noexcept;
+
+  private:
+    std::size_t m_capacity;
+    std::unique_ptr<char[]> m_ring;
+    std::atomic<std::uint64_t> m_claimed = 0; // bytes up to there may be being written
+    std::atomic<std::uint64_t> m_end = 0;     // bytes up to there are written
+    std::atomic<std::uint64_t> m_cleared = 0; // bytes up to there are dropped
+};
+
+} // namespace smce
+
+#endif // SMCE_RUNTIMELOG_HPP
@@ -0,0 +1,237 @@
+/*
+ *  Scheduler.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_SCHEDULER_HPP
+#define SMCE_SCHEDULER_HPP
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "SMCE/BoardView.hpp"
+
+namespace smce {
+
+template <class T = void>
+class Task;
+
+namespace detail {
+
+template <class T>
+struct TaskResult {
+    std::optional<T> value;
+    template <class U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+    T take() { return std::move(*value); }
+};
+
+template <>
+struct TaskResult<void> {
+    void return_void() noexcept {}
+    void take() noexcept {}
+};
+
+} // namespace detail
+
+/**
+ * Coroutine driven by a `Scheduler`, producing a value of type T
+ *
+ * Starts suspended, and runs once spawned on a scheduler or awaited by another task;
+ * an awaiting task resumes as soon as the awaited one is done, without going through the scheduler.
+ * Exceptions escaping the coroutine are rethrown to whoever awaits it.
+ **/
+template <class T>
+class [[nodiscard]] Task {
+  public:
+    struct promise_type : detail::TaskResult<T> {
+        std::coroutine_handle<> continuation; // resumed once done, if awaited
+        std::exception_ptr exception;
+
+        Task get_return_object() noexcept { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct Final {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) noexcept {
+                    const auto next = self.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            return Final{};
+        }
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept : m_handle{std::exchange(other.m_handle, {})} {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    /// Whether the coroutine ran to completion
+    [[nodiscard]] bool done() const noexcept { return !m_handle || m_handle.done(); }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() noexcept { return handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() {
+                if (handle.promise().exception)
+                    std::rethrow_exception(handle.promise().exception);
+                return handle.promise().take();
+            }
+        };
+        return Awaiter{m_handle};
+    }
+
+  private:
+    friend class Scheduler;
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : m_handle{handle} {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+/**
+ * Drives host-side tasks waiting on the effects of sketches, all from a single thread
+ *
+ * Awaitables suspend the awaiting task until a condition holds on a board or a timeout expires,
+ * and evaluate to whether the condition held. The thread calling `run` resumes tasks as their awaitables
+ * get ready, and polls the conditions of the pending ones in-between; as checking a condition only costs
+ * a few atomic loads in shared memory, thousands of tasks can wait at once on a single thread. Polling backs off
+ * from `min_poll_period` to `max_poll_period` while nothing gets ready, and never oversleeps a timeout.
+ * \note Not thread-safe: tasks get spawned from and run on the thread calling `run`.
+ **/
+class Scheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Shortest time between two polls of the pending awaitables
+    static constexpr std::chrono::microseconds min_poll_period{50};
+    /// Longest time between two polls of the pending awaitables
+    static constexpr std::chrono::milliseconds max_poll_period{1};
+
+    /// Awaitable pending on a condition, linked to its scheduler while its coroutine is suspended
+    class Wait {
+        friend Scheduler;
+
+      protected:
+        Wait(Scheduler& sched, std::chrono::nanoseconds timeout, bool (*ready)(Wait&)) noexcept;
+
+      public:
+        Wait(const Wait&) = delete;
+        Wait& operator=(const Wait&) = delete;
+
+        bool await_ready() noexcept { return m_ready = m_check(*this); }
+        void await_suspend(std::coroutine_handle<> awaiting);
+        /// Whether the condition held before the timeout expired
+        [[nodiscard]] bool await_resume() const noexcept { return m_ready; }
+
+      private:
+        Scheduler& m_sched;
+        Clock::time_point m_deadline;
+        bool (*m_check)(Wait&);
+        std::coroutine_handle<> m_awaiting;
+        bool m_ready = false;
+    };
+
+    /// Awaitable pending on an arbitrary condition
+    template <class Ready>
+    class Until : public Wait {
+      public:
+        Until(Scheduler& sched, Ready ready, std::chrono::nanoseconds timeout)
+            : Wait{sched, timeout, [](Wait& self) -> bool { return static_cast<Until&>(self).m_ready_fn(); }},
+              m_ready_fn{std::move(ready)} {}
+
+      private:
+        Ready m_ready_fn;
+    };
+
+    Scheduler() noexcept = default;
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /// Hands a task over, to start on the next `run`
+    void spawn(Task<> task);
+    /**
+     * Drives the spawned tasks until they are all done
+     * \throws whatever escaped a spawned task, as soon as it did; the others are left for the next `run`
+     **/
+    void run();
+    /// Number of spawned tasks not done yet
+    [[nodiscard]] std::size_t pending() const noexcept { return m_tasks.size(); }
+
+    /**
+     * Awaits a condition
+     * \param ready - callable checking the condition; invoked on the thread calling `run`, and must not block
+     * \param timeout - wall time to give up after, from the creation of the awaitable
+     **/
+    template <class Ready>
+    [[nodiscard]] Until<Ready> until(Ready ready, std::chrono::nanoseconds timeout) {
+        return {*this, std::move(ready), timeout};
+    }
+    /// Awaits a UART buffer holding at least a number of bytes to read (e.g. tx, for what the sketch printed)
+    [[nodiscard]] auto bytes(VirtualUartBuffer buf, std::size_t count, std::chrono::nanoseconds timeout) {
+        return until([buf, count]() mutable { return buf.size() >= count; }, timeout);
+    }
+    /// Awaits a pin digitally reading a value
+    [[nodiscard]] auto pin_equals(VirtualDigitalDriver pin, bool value, std::chrono::nanoseconds timeout) {
+        return until([pin, value]() mutable { return pin.read() == value; }, timeout);
+    }
+    /// Awaits a pin reading an analog value
+    [[nodiscard]] auto pin_equals(VirtualAnalogDriver pin, std::uint16_t value, std::chrono::nanoseconds timeout) {
+        return until([pin, value]() mutable { return pin.read() == value; }, timeout);
+    }
+    /// Awaits a frame getting written to a frame-buffer, after the creation of the awaitable
+    [[nodiscard]] auto frame_update(FrameBuffer fb, std::chrono::nanoseconds timeout) {
+        return until([fb, frames = fb.frame_count()]() mutable { return fb.frame_count() != frames; }, timeout);
+    }
+    /// Awaits some wall time; always evaluates to false
+    [[nodiscard]] auto sleep_for(std::chrono::nanoseconds duration) {
+        return until([] { return false; }, duration);
+    }
+
+  private:
+    void reap();
+
+    std::vector<Task<>> m_tasks;
+    std::vector<std::coroutine_handle<>> m_runnable; // to resume on the next round
+    std::vector<Wait*> m_waits;                      // pending awaitables
+};
+
+} // namespace smce
+
+#endif // SMCE_SCHEDULER_HPP
@@ -37,6 +37,7 @@ enum class sketch_error {
  **/
 class Sketch {
     friend Board;
+    friend ForkServer;
     friend Toolchain;
 
     Uuid m_uuid = Uuid::generate();
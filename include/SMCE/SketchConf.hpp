@@ -66,6 +66,11 @@ struct SketchConfig {
     std::vector<Library> complink_libs;          /// Libraries to use at compile and link time
     std::vector<std::string> extra_compile_defs; /// Arguments to CMake's target_compile_definitions
     std::vector<std::string> extra_compile_opts; /// Arguments to CMake's target_compile_options
+    /**
+     * Build the sketch as a shared object, run by its board on a thread of the host process
+     * \note See Board for the limitations of in-process sketches
+     **/
+    bool in_process = false;
 };
 
 } // namespace smce
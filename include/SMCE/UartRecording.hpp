@@ -0,0 +1,148 @@
+/*
+ *  UartRecording.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_UARTRECORDING_HPP
+#define SMCE_UARTRECORDING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+#include "SMCE/BoardView.hpp"
+#include "SMCE/SMCE_fs.hpp"
+
+namespace smce {
+
+/**
+ * Records the traffic of every UART channel of a board, both ways, into an append-only memory-mapped file
+ *
+ * One thread per buffer follows its producer, copying what gets enqueued straight out of the ring whenever
+ * the tail moves, and stamps each chunk with the board time it was seen at. The transport path is left as is:
+ * no locks nor copies get added to `VirtualUartBuffer::read`/`write`, which only pay for waking the recorder up.
+ * The file is preallocated (sparsely) to a capacity, and cut down to what was recorded when stopping.
+ * \note As it observes from the side, the recorder misses bytes if it falls more than a buffer behind the reader
+ *       of a channel; those are counted by `lost`. That slack costs twice the buffer memory, so it only exists
+ *       for channels configured as `recordable`, and boards with other channels cannot be recorded.
+ *       The board must outlive the recorder.
+ * \note Each thread appends its records in time order, but records of distinct buffers may interleave out of it;
+ *       `UartReplayer` sorts them back.
+ **/
+class UartRecorder {
+  public:
+    /// Default most bytes a recording holds, headers included
+    static constexpr std::size_t default_capacity = 64 * 1024 * 1024;
+    /// Longest the recording threads take to notice `stop`
+    static constexpr std::chrono::milliseconds stop_latency{50};
+
+    explicit UartRecorder(BoardView view) noexcept;
+    ~UartRecorder();
+
+    UartRecorder(const UartRecorder&) = delete;
+    UartRecorder& operator=(const UartRecorder&) = delete;
+
+    /**
+     * Creates the recording file (replacing any previous one) and starts recording
+     * \param path - path of the file
+     * \param capacity - most bytes to record, headers included; traffic past it is counted as lost
+     * \return false on failure, if already recording, or if a UART channel of the board is not `recordable`
+     **/
+    bool start(const stdfs::path& path, std::size_t capacity = default_capacity);
+    /// Stops recording and closes the file
+    void stop() noexcept;
+
+    /// Whether the recorder is running
+    [[nodiscard]] bool running() const noexcept { return m_run; }
+    /// Bytes of traffic missed so far
+    [[nodiscard]] std::size_t lost() const noexcept { return m_lost; }
+
+  private:
+    struct Mapping;
+
+    void record(std::size_t channel, bool tx, std::uint32_t pos) noexcept;
+    void append(std::size_t channel, bool tx, std::chrono::nanoseconds time, std::span<const char> bytes) noexcept;
+
+    BoardView m_view;
+    std::atomic_bool m_run = false;
+    std::atomic_size_t m_end = 0; // end of the records appended so far
+    std::atomic_size_t m_lost = 0;
+    std::unique_ptr<Mapping> m_map;
+    stdfs::path m_path;
+    std::vector<std::thread> m_threads;
+};
+
+/**
+ * Read-only view of a recording of UART traffic, replayable into a board
+ * \note Recordings are in host byte order; not meant to be sent across machines.
+ **/
+class UartReplayer {
+  public:
+    // clang-format off
+    enum class Pacing {
+        original,  /// Bytes get sent at the same board times as recorded, relative to the first
+        max_speed, /// Bytes get sent as fast as the board takes them
+    };
+    // clang-format on
+
+    struct Record {
+        std::chrono::nanoseconds time; /// Board time the bytes were seen at
+        std::size_t channel;           /// Index of the UART channel
+        bool tx;                       /// Whether the bytes went from the sketch to the host
+        std::span<const char> bytes;   /// Bytes that went through; points into the mapped recording
+    };
+
+    UartReplayer() noexcept;
+    ~UartReplayer();
+
+    UartReplayer(const UartReplayer&) = delete;
+    UartReplayer& operator=(const UartReplayer&) = delete;
+
+    /**
+     * Maps a recording made by `UartRecorder`
+     * \return false if the file cannot be mapped or is not a recording, in which case no records are left
+     **/
+    bool open(const stdfs::path& path);
+
+    /// Records of the recording, in time order (and in the order they were appended for equal times)
+    [[nodiscard]] const std::vector<Record>& records() const noexcept { return m_records; }
+
+    /**
+     * Sends the rx traffic of the recording again, through the rx buffers of a board
+     *
+     * Blocks until done; channels absent from the board are skipped.
+     * \param view - board to replay into
+     * \param pacing - how fast to send
+     * \param stall_timeout - wall time after which to give up on an rx buffer that stays full
+     * \return number of bytes sent
+     **/
+    std::size_t replay(BoardView view, Pacing pacing,
+                       std::chrono::nanoseconds stall_timeout = std::chrono::seconds{1}) const noexcept;
+
+  private:
+    struct Mapping;
+
+    std::unique_ptr<Mapping> m_map;
+    std::vector<Record> m_records;
+};
+
+} // namespace smce
+
+#endif // SMCE_UARTRECORDING_HPP
@@ -23,14 +23,22 @@ namespace smce {
 
 struct BoardConfig;
 class Board;
+class BoardFleet;
+class BoardPool;
+class BoardSnapshot;
 class BoardView;
+class ForkServer;
+class Scheduler;
 class Sketch;
 class Toolchain;
+class UartRecorder;
 struct SketchConfig;
 class Uuid;
 
 /// \internal
 struct BoardData;
+/// \internal
+class Reactor;
 } // namespace smce
 
 #endif // SMCE_FWD_HPP
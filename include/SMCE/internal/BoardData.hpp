@@ -19,12 +19,14 @@
 #ifndef SMCE_BOARDDATA_HPP
 #define SMCE_BOARDDATA_HPP
 
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
-#include <deque>
 #include <memory>
 #include <optional>
+#include <span>
 #include <vector>
 
 #include <boost/predef.h>
@@ -32,7 +34,6 @@
 #include <boost/atomic/ipc_atomic.hpp>
 #include <boost/atomic/ipc_atomic_flag.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
-#include <boost/interprocess/containers/deque.hpp>
 #include <boost/interprocess/containers/string.hpp>
 #include <boost/interprocess/containers/vector.hpp>
 #if BOOST_OS_WINDOWS
@@ -40,7 +41,6 @@
 #else
 #    include <boost/interprocess/managed_shared_memory.hpp>
 #endif
-#include <boost/interprocess/sync/spin/mutex.hpp>
 #include "SMCE/fwd.hpp"
 
 namespace smce {
@@ -63,11 +63,31 @@ struct IpcAtomicValue : boost::ipc_atomic<T> {
     }
 };
 
-/// \internal
-struct IpcMovableMutex : boost::interprocess::ipcdetail::spin_mutex {
+/**
+ * \internal
+ * Mutex for shared memory, spinning briefly before blocking on a (cross-process) futex
+ *
+ * Waiters thus sleep rather than burn a core while the owner is descheduled or stopped (suspended sketches).
+ * Should the owning process die with the lock held, a waiter takes the lock over within `owner_check_period`;
+ * what it guards is then in whatever state the dead owner left it.
+ **/
+struct IpcMovableMutex {
+    static constexpr int spin_count = 100;
+    static constexpr std::chrono::milliseconds owner_check_period{10};
+    // clang-format off
+    enum : std::uint32_t { unlocked, locked, contended };
+    // clang-format on
+
+    IpcAtomicValue<std::uint32_t> state = unlocked; // rw
+    IpcAtomicValue<std::int32_t> owner = 0;         // rw; pid of the owning process, 0 while unknown
+
     IpcMovableMutex() noexcept = default;
     IpcMovableMutex(IpcMovableMutex&&) noexcept {}                           // HSD never
     IpcMovableMutex& operator=(IpcMovableMutex&&) noexcept { return *this; } // HSD never
+
+    bool try_lock() noexcept;
+    void lock() noexcept;
+    void unlock() noexcept;
 };
 
 #if BOOST_OS_WINDOWS
@@ -87,6 +107,21 @@ using ShmString = ShmBasicString<char>;
 
 /// \internal
 struct BoardData {
+    static constexpr std::size_t cache_line_size = 64;
+
+    // clang-format off
+    enum class RunCommand : std::uint8_t {
+        run,
+        suspend,
+        stop,
+    };
+    // clang-format on
+    struct Clock {
+        IpcAtomicValue<std::uint32_t> seq = 0;         // rw; odd while being updated
+        IpcAtomicValue<std::int64_t> wall_origin = 0;  // ro; steady clock time (ns) at which board time was board_origin
+        IpcAtomicValue<std::int64_t> board_origin = 0; // ro; ns
+        IpcAtomicValue<double> speed_factor = 1.0;     // ro; 0 when stepped by the host
+    };
     struct Pin {
         // clang-format off
         enum class DataDirection {
@@ -102,26 +137,94 @@ struct BoardData {
         };
         // clang-format on
         std::uint16_t id;                                                 // ro
+        std::uint16_t value_slot = 0;                                     // ro; index of the value in pin_values
         bool can_digital_read = false;                                    // ro
         bool can_digital_write = false;                                   // ro
         bool can_analog_read = false;                                     // ro
         bool can_analog_write = false;                                    // ro
-        IpcAtomicValue<std::uint16_t> value = 0;                          // rw
         IpcAtomicValue<DataDirection> data_direction = DataDirection::in; // rw
         IpcAtomicValue<ActiveDriver> active_driver = ActiveDriver::gpio;  // rw
     };
+    struct PinEvent {
+        std::int64_t time;   // board time (ns) of the change
+        std::uint16_t pin;   // id of the pin
+        std::uint16_t value; // new value
+    };
+    /**
+     * Lock-free single-producer single-consumer queue
+     *
+     * The producer only moves the tail and the consumer only moves the head; both count the elements
+     * that ever went through (wrapping around), and sit on cache lines of their own.
+     * Either side can block until the other moves its counter, which doubles as a (cross-process) futex;
+     * moving a counter only costs a wake-up call when someone is waiting on it.
+     * \note Instantiated for bytes and pin events only
+     **/
+    template <class T>
+    struct Ring {
+        using Counter = IpcAtomicValue<std::uint32_t>;
+        Counter head = 0;         // rw by the consumer
+        Counter head_waiters = 0; // rw; number of producers waiting for room
+        std::array<std::byte, cache_line_size - 2 * sizeof(Counter)> head_padding{};
+        Counter tail = 0;         // rw by the producer
+        Counter tail_waiters = 0; // rw; number of consumers waiting for elements
+        std::array<std::byte, cache_line_size - 2 * sizeof(Counter)> tail_padding{};
+        std::uint16_t capacity;                               // ro; most elements queued at once
+        boost::interprocess::vector<T, ShmAllocator<T>> data; // ro; power-of-two sized storage
+
+        /// Number of storage slots for a capacity; twice as many if observers are to trail behind the consumer
+        [[nodiscard]] static std::size_t storage_size(std::uint16_t capacity, bool observable = false) noexcept;
+
+        Ring(const ShmAllocator<void>&, std::uint16_t capacity, bool observable = false);
+        /// Number of elements queued
+        [[nodiscard]] std::size_t size() const noexcept;
+        /// Dequeues elements; consumer only
+        std::size_t read(std::span<T>) noexcept;
+        /// Enqueues as many elements as fit; producer only
+        std::size_t write(std::span<const T>) noexcept;
+        /**
+         * Copies the queued elements without dequeuing them
+         * \note Callable by anyone, as it retries if the consumer dequeued meanwhile
+         **/
+        std::size_t peek(std::span<T>) const noexcept;
+        /**
+         * Copies the elements enqueued since a stream position, whether dequeued or not, for observers of the ring
+         * \param pos - stream position to copy from; moved past the elements copied or lost
+         * \param lost - set to the number of elements overwritten before they could be copied (skipped over)
+         * \return number of elements copied
+         * \note Callable by anyone; as the producer does not wait for them, observers may only trail behind the
+         *       consumer by the storage left over past the capacity (a capacity's worth if observable, else none)
+         **/
+        std::size_t snoop(std::uint32_t& pos, std::span<T>, std::size_t& lost) const noexcept;
+        /// Queued elements, in place; split in two where they wrap around; consumer only
+        [[nodiscard]] std::array<std::span<const T>, 2> readable() const noexcept;
+        /// Dequeues elements that were read in place; consumer only; returns how many
+        std::size_t consume(std::size_t count) noexcept;
+        /// Room left to enqueue elements, in place; split in two where it wraps around; producer only
+        [[nodiscard]] std::array<std::span<T>, 2> writable() noexcept;
+        /// Enqueues elements that were written in place; producer only; returns how many
+        std::size_t commit(std::size_t count) noexcept;
+        /// Blocks until there are elements to read or the timeout expires; returns whether there are
+        bool wait_readable(std::chrono::nanoseconds timeout) noexcept;
+        /// Blocks until there is room to write or the timeout expires; returns whether there is
+        bool wait_writable(std::chrono::nanoseconds timeout) noexcept;
+        /// Blocks until the tail moved past a stream position or the timeout expires; returns whether it did
+        bool wait_enqueued(std::uint32_t pos, std::chrono::nanoseconds timeout) noexcept;
+    };
+    using ByteRing = Ring<char>;
+    using PinEventRing = Ring<PinEvent>;
     struct UartChannel {
-        IpcAtomicValue<bool> active = false; // rw
-        IpcMovableMutex rx_mut;
-        IpcMovableMutex tx_mut;
-        boost::interprocess::deque<char, ShmAllocator<char>> rx; // rw
-        boost::interprocess::deque<char, ShmAllocator<char>> tx; // rw
-        std::uint16_t max_buffered_rx;                           // ro
-        std::uint16_t max_buffered_tx;                           // ro
-        std::uint16_t baud_rate;                                 // ro
-        std::optional<std::uint16_t> rx_pin_override;            // ro
-        std::optional<std::uint16_t> tx_pin_override;            // ro
-        explicit UartChannel(const ShmAllocator<void>&);
+        IpcAtomicValue<bool> active = false;                 // rw
+        ByteRing rx;                                         // rw; host to sketch
+        ByteRing tx;                                         // rw; sketch to host
+        IpcAtomicValue<bool> paced = false;                  // rw; whether bytes get through at the baud rate
+        IpcAtomicValue<std::int64_t> rx_line_busy_until = 0; // rw by the host; board time (ns) the last rx byte is in
+        IpcAtomicValue<std::int64_t> tx_line_busy_until = 0; // rw by the sketch; same for tx
+        std::uint32_t baud_rate;                             // ro
+        std::uint16_t flushing_threshold = 0;                // ro; bytes the sketch stages before writing to tx
+        bool recordable;                                     // ro; whether the rings leave room for a recorder
+        std::optional<std::uint16_t> rx_pin_override;        // ro
+        std::optional<std::uint16_t> tx_pin_override;        // ro
+        UartChannel(const ShmAllocator<void>&, std::uint16_t rx_capacity, std::uint16_t tx_capacity, bool recordable);
     };
     struct DirectStorage {
         // clang-format off
@@ -155,17 +258,45 @@ struct BoardData {
         IpcAtomicValue<std::uint16_t> height = 0; // rw
         IpcAtomicValue<std::uint8_t> freq = 0;    // rw
         IpcAtomicValue<Transform> transform{};    // rw
+        IpcAtomicValue<std::uint32_t> frames = 0; // rw; number of frames written, wrapping around
         IpcMovableMutex data_mut;
         boost::interprocess::vector<std::byte, ShmAllocator<std::byte>> data; // rw
         explicit FrameBuffer(const ShmAllocator<void>&);
     };
 
+    using PinValue = IpcAtomicValue<std::uint16_t>;
+
+    static constexpr std::uint16_t no_pin = 0xFFFF;
+
     boost::interprocess::vector<Pin, ShmAllocator<Pin>> pins; // sorted by id
+    /// Index in `pins` of every pin id up to the largest one, or `no_pin`; spares lookups a search
+    boost::interprocess::vector<std::uint16_t, ShmAllocator<std::uint16_t>> pin_indices;
+    /**
+     * Values of the pins, kept apart from the rest of their data as they are written to all the time
+     *
+     * Values written by the host (those of pins the board only reads) are grouped, as are the ones written by
+     * the sketch, with a cache line of padding around each group, so that the host and the sketch do not keep on
+     * stealing cache lines from each other when writing to distinct pins.
+     **/
+    boost::interprocess::vector<PinValue, ShmAllocator<PinValue>> pin_values;
     boost::interprocess::vector<UartChannel, ShmAllocator<UartChannel>> uart_channels;
     boost::interprocess::vector<DirectStorage, ShmAllocator<DirectStorage>> direct_storages;
     boost::interprocess::vector<FrameBuffer, ShmAllocator<FrameBuffer>> frame_buffers;
+    /// Changes of the values of the pins written by the sketch, in order; empty if disabled
+    PinEventRing pin_events;
+    IpcAtomicValue<std::uint64_t> pin_events_dropped = 0; // rw by the sketch; changes not queued as it was full
+    Clock clock;
+    IpcAtomicValue<RunCommand> run_command = RunCommand::run; // ro; only honored by in-process sketches
+    bool prefault = false;                                    // ro; whether the sketch prefaults its mapping too
 
     BoardData(const ShmAllocator<void>&, const BoardConfig&) noexcept;
+
+    /// Value of a pin, by index in `pins`
+    PinValue& pin_value(std::size_t idx) noexcept { return pin_values[pins[idx].value_slot]; }
+    /// Index in `pins` of a pin, by id; `no_pin` if there is none
+    [[nodiscard]] std::size_t pin_index(std::size_t pin_id) const noexcept {
+        return pin_id < pin_indices.size() ? pin_indices[pin_id] : no_pin;
+    }
 };
 
 } // namespace smce
@@ -0,0 +1,67 @@
+/*
+ *  BoardInternal.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_BOARDINTERNAL_HPP
+#define SMCE_BOARDINTERNAL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <boost/dll/shared_library.hpp>
+#include <boost/process.hpp>
+#include "SMCE/Board.hpp"
+#include "SMCE/SMCE_fs.hpp"
+#include "SMCE/internal/Reactor.hpp"
+#include "SMCE/Uuid.hpp"
+#include "SMCE/internal/SharedBoardData.hpp"
+
+namespace smce {
+
+/// \internal
+struct Board::Internal {
+    Uuid uuid = Uuid::generate();
+    SharedBoardData sbdata;
+    boost::process::child sketch;
+    boost::process::ipstream sketch_log;
+    boost::process::opstream sketch_gate; // sketch is parked until something is written to it
+    std::thread sketch_log_grabber;       // unless the log is drained by the reactor
+    Reactor* reactor = nullptr;           // reactor watching the sketch
+    Reactor::Token sketch_log_watch{};    // watch of the log pipe
+    int sketch_pidfd = -1;                // Linux only; -1 if unsupported, in which case exits get polled for
+    Reactor::Token sketch_exit_watch{};   // watch of the pidfd
+    std::atomic<bool> sketch_exited = false;
+    std::chrono::steady_clock::time_point sketch_start_time{};
+
+    void watch_exit(Reactor&) noexcept;
+    void unwatch_exit() noexcept;
+
+    // In-process sketches only
+    boost::dll::shared_library sketch_module;
+    stdfs::path sketch_module_copy; // private to this board, so that sketches do not share globals
+    std::thread sketch_thread;
+    std::mutex sketch_exit_mtx;
+    std::condition_variable sketch_exit_cv; // notified once `sketch_exited`
+    std::atomic<int> sketch_exit_code = 0;
+    std::atomic<int> sketch_tid = 0; // Linux only
+};
+
+} // namespace smce
+
+#endif // SMCE_BOARDINTERNAL_HPP
@@ -0,0 +1,94 @@
+/*
+ *  Reactor.hpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef SMCE_REACTOR_HPP
+#define SMCE_REACTOR_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace smce {
+
+/**
+ * \internal
+ * Event loop dispatching the readiness of file descriptors to handlers, on its own thread
+ *
+ * Handlers run on the reactor thread, one at a time, and must not block.
+ * Watches are one-shot: a handler returns whether to keep watching, re-arming its watch.
+ * \note Only supported on Linux (epoll); `valid()` is always false elsewhere.
+ **/
+class Reactor {
+  public:
+    using Handler = std::function<bool(std::uint32_t events)>;
+    using Token = std::uint64_t;
+
+    Reactor() noexcept;
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    /// Process-wide reactor, started on first use
+    static Reactor& shared() noexcept;
+
+    /// Whether the event loop is running
+    [[nodiscard]] bool valid() const noexcept { return m_loop.joinable(); }
+
+    /**
+     * Starts watching a file descriptor
+     * \param fd - the file descriptor to watch; must stay open until removed
+     * \param events - epoll events to watch for (e.g. `EPOLLIN`)
+     * \param handler - callback invoked with the ready events
+     * \return a token to remove the watch with, or 0 on failure
+     **/
+    Token add(int fd, std::uint32_t events, Handler handler) noexcept;
+
+    /**
+     * Stops watching a file descriptor
+     * \param token - the token obtained when adding the watch
+     * \note Once this returns, the handler is neither running nor going to be called (unless called from it)
+     **/
+    void remove(Token token) noexcept;
+
+  private:
+    struct Watch {
+        int fd;
+        std::uint32_t events;
+        std::shared_ptr<Handler> handler;
+    };
+
+    void run() noexcept;
+
+    int m_epoll_fd = -1;
+    int m_wake_fd = -1; // eventfd to interrupt the loop with
+    std::mutex m_mtx;
+    std::condition_variable m_dispatch_cv;
+    std::unordered_map<Token, Watch> m_watches;
+    Token m_next_token = 1;
+    Token m_dispatching = 0; // token whose handler is running
+    std::thread m_loop;
+};
+
+} // namespace smce
+
+#endif // SMCE_REACTOR_HPP
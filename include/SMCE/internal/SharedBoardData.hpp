@@ -19,6 +19,8 @@
 #ifndef SMCE_SHAREDBOARDDATA_HPP
 #define SMCE_SHAREDBOARDDATA_HPP
 
+#include <memory>
+#include <boost/interprocess/managed_external_buffer.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
 #include "SMCE/internal/BoardData.hpp"
 
@@ -26,19 +28,47 @@ namespace smce {
 
 /// \internal
 class SharedBoardData {
+    // Same segment manager as the shared memory, so that BoardData can live in either
+    using BufferSegment = boost::interprocess::basic_managed_external_buffer<
+        char, boost::interprocess::rbtree_best_fit<boost::interprocess::mutex_family>, boost::interprocess::iset_index>;
+
     boost::interprocess::managed_shared_memory m_shm;
+    BufferSegment m_buf_seg;             // over the heap or a memory file mapping
+    std::unique_ptr<std::byte[]> m_heap; // in-process boards only
+    int m_fd = -1;                       // memory file of anonymous segments (Linux only)
+    void* m_map = nullptr;               // mapping of that file
+    std::size_t m_map_size = 0;
     std::string m_name;
     BoardData* m_bd = nullptr;
     bool m_master = false;
 
+    bool configure_anonymous(const BoardConfig&);
+    bool map_file(int fd, std::size_t size, bool populate);
+
   public:
     SharedBoardData() = default;
     ~SharedBoardData();
+
+    /**
+     * Size of the segment needed to hold the board data of a configuration
+     * \note Frame-buffers are accounted for at their maximum resolution
+     **/
+    static std::size_t required_size(const BoardConfig&) noexcept;
+
     bool configure(std::string_view, const BoardConfig&);
+    bool configure_in_process(const BoardConfig&);
     bool open_as_child(const char*);
+    /// Opens an anonymous segment from its memory file, inherited from the host
+    bool open_as_child(int);
     void reset();
 
     BoardData* get_board_data() noexcept { return m_bd; }
+    /// Memory file of the segment to hand down to the sketch, or -1 if the segment is named
+    int segment_fd() const noexcept { return m_fd; }
+    /// Size of the segment, or 0 if none
+    std::size_t segment_size() noexcept;
+    /// Bytes in use within the segment
+    std::size_t segment_used() noexcept;
 };
 
 } // namespace smce
@@ -21,4 +21,10 @@
 extern void setup();
 extern void loop();
 
+#if SMCE__SKETCH_IN_PROCESS
+extern "C" SMCE__DLL_API int SMCE__sketch_entry(void* board_data) {
+    return SMCE__run_in_process(board_data, setup, loop);
+}
+#else
 int main(int argc, char** argv) { return SMCE__main(argc, argv, setup, loop); }
+#endif
@@ -18,13 +18,14 @@
 
 #include <chrono>
 #include <iostream>
-#include <thread>
 #include "Ardrivo/Arduino.h"
 #include "SMCE/BoardView.hpp"
 
 namespace smce {
-extern BoardView board_view;
+extern thread_local BoardView board_view;
 extern void maybe_init();
+extern void sleep_for(std::chrono::nanoseconds);
+extern void publish_stale_serial_staging() noexcept;
 } // namespace smce
 
 using namespace smce;
@@ -79,7 +80,10 @@ void digitalWrite(int pin, bool value) {
     if (vpin.get_direction() != VirtualPin::DataDirection::out)
         return error("Pin is in input mode");
 
+    const auto previous = vpin.analog().read(); // raw value, as digital reads only tell zero from non-zero
     vpin.digital().write(value);
+    if (const std::uint16_t current = value ? 255 : 0; current != previous)
+        board_view.pin_events.push(static_cast<std::uint16_t>(pin), current);
 }
 
 int analogRead(int pin) {
@@ -117,23 +121,26 @@ void analogWrite(int pin, byte value) {
     if (vpin.get_direction() != VirtualPin::DataDirection::out)
         return error("Pin is in input mode");
 
+    const auto previous = vpin.analog().read();
     vpin.analog().write(value);
+    if (value != previous)
+        board_view.pin_events.push(static_cast<std::uint16_t>(pin), value);
 }
 
-void delay(unsigned long long ms) { std::this_thread::sleep_for(std::chrono::milliseconds{ms}); }
+void delay(unsigned long long ms) { smce::sleep_for(std::chrono::milliseconds{ms}); }
 
-void delayMicroseconds(unsigned long long us) { std::this_thread::sleep_for(std::chrono::microseconds{us}); }
-
-static const auto start_time = std::chrono::steady_clock::now();
+void delayMicroseconds(unsigned long long us) { smce::sleep_for(std::chrono::microseconds{us}); }
 
 unsigned long micros() {
-    const auto current_time = std::chrono::steady_clock::now();
+    maybe_init();
+    publish_stale_serial_staging(); // sketches busy-waiting on the clock never yield otherwise
     return static_cast<unsigned long>(
-        std::chrono::duration_cast<std::chrono::microseconds>(current_time - start_time).count());
+        std::chrono::duration_cast<std::chrono::microseconds>(board_view.clock.now()).count());
 }
 
 unsigned long millis() {
-    const auto current_time = std::chrono::steady_clock::now();
+    maybe_init();
+    publish_stale_serial_staging();
     return static_cast<unsigned long>(
-        std::chrono::duration_cast<std::chrono::milliseconds>(current_time - start_time).count());
+        std::chrono::duration_cast<std::chrono::milliseconds>(board_view.clock.now()).count());
 }
\ No newline at end of file
@@ -16,18 +16,37 @@
  *
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <limits>
+#include <span>
+#include <vector>
 #include <SMCE/BoardView.hpp>
+#include "Arduino.h"
 #include "HardwareSerial.h"
 #include "SMCE_dll.hpp"
 
 namespace smce {
-extern BoardView board_view;
+extern thread_local BoardView board_view;
 extern void maybe_init();
 } // namespace smce
 
 using namespace smce;
+using namespace std::literals::chrono_literals;
+
+// Longest wall time `timedRead` sleeps at once, as to notice the board time running out of its timeout
+constexpr auto rx_wait_slice = 1ms;
+// Staged bytes older than this get published on the next write or clock read, even if below the flushing threshold
+constexpr auto max_staging_delay = 1ms;
+// Longest `flush` waits for the host to make room in the tx buffer
+constexpr auto flush_timeout = 100ms;
+
+/// Bytes written by the sketch but not published to the tx buffer yet
+struct TxStaging {
+    std::vector<char> bytes;
+    std::chrono::steady_clock::time_point since; // when the oldest staged byte was written
+};
 
 struct SMCE_HardwareSerialImpl : HardwareSerial {
     explicit SMCE_HardwareSerialImpl(int id) noexcept : m_id{id} {}
@@ -36,11 +55,78 @@ struct SMCE_HardwareSerialImpl : HardwareSerial {
         maybe_init();
         return board_view.uart_channels[m_id];
     }
+
+    /// \note Per thread, as in-process sketches share the serial objects (each running on its own thread)
+    TxStaging& staging() noexcept {
+        thread_local std::vector<TxStaging> stagings;
+        const auto idx = static_cast<std::size_t>(m_id);
+        if (stagings.size() <= idx)
+            stagings.resize(idx + 1); // sized by the serial objects actually in use
+        return stagings[idx];
+    }
+
+    /// Publishes as many staged bytes as fit in the tx buffer
+    void publish() noexcept {
+        auto& stage = staging();
+        if (stage.bytes.empty())
+            return;
+        const auto written = view().tx().write(stage.bytes);
+        stage.bytes.erase(stage.bytes.begin(), stage.bytes.begin() + static_cast<std::ptrdiff_t>(written));
+        stage.since = std::chrono::steady_clock::now();
+    }
+
+    /// Publishes the staged bytes if they are older than `max_staging_delay`
+    void publish_if_stale() noexcept {
+        auto& stage = staging();
+        if (!stage.bytes.empty() && std::chrono::steady_clock::now() - stage.since >= max_staging_delay)
+            publish();
+    }
+
+    /**
+     * Writes bytes out, staging them until the flushing threshold is reached if the channel has one
+     * \return number of bytes accepted; short when the tx buffer is full
+     **/
+    std::size_t stage(std::span<const char> bytes) {
+        auto uart = view();
+        const auto threshold = uart.flushing_threshold();
+        if (threshold == 0)
+            return uart.tx().write(bytes);
+
+        auto& stage = staging();
+        const auto now = std::chrono::steady_clock::now();
+        if (stage.bytes.empty())
+            stage.since = now;
+        std::size_t accepted = 0;
+        while (!bytes.empty()) {
+            if (stage.bytes.size() >= threshold) {
+                publish();
+                if (stage.bytes.size() >= threshold)
+                    break; // the tx buffer is full
+            }
+            const auto chunk = std::min(bytes.size(), threshold - stage.bytes.size());
+            stage.bytes.insert(stage.bytes.end(), bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(chunk));
+            bytes = bytes.subspan(chunk);
+            accepted += chunk;
+        }
+        if (stage.bytes.size() >= threshold || now - stage.since >= max_staging_delay)
+            publish();
+        return accepted;
+    }
 };
 
 SMCE_HardwareSerialImpl Serial_impl{0};
 SMCE__DLL_API HardwareSerial& Serial{Serial_impl};
 
+namespace smce {
+/// Publishes what the sketch staged on its serial channels; called whenever it sleeps or finishes a loop
+void publish_serial_staging() noexcept { Serial_impl.publish(); }
+/**
+ * Publishes what the sketch staged on its serial channels a while ago
+ * \note Called whenever the sketch reads the clock, as sketches busy-waiting on it never sleep
+ **/
+void publish_stale_serial_staging() noexcept { Serial_impl.publish_if_stale(); }
+} // namespace smce
+
 constexpr SMCE_HardwareSerialImpl& upcast(HardwareSerial& obj) {
     return static_cast<SMCE_HardwareSerialImpl&>(obj); // NOLINT
 }
@@ -58,31 +144,33 @@ void HardwareSerial::end() {
 int HardwareSerial::available() {
     if (!upcast(*this).view().is_active())
         return std::cerr << "HardwareSerial::available(): Device inactive" << std::endl, 0;
+    upcast(*this).publish(); // the sketch is likely waiting on a reply to what it wrote
     return static_cast<int>(upcast(*this).view().rx().size());
 }
 
 int HardwareSerial::availableForWrite() {
     if (!upcast(*this).view().is_active())
         return std::cerr << "HardwareSerial::availableForWrite(): Device inactive" << std::endl, 0;
-    auto tx_buf = upcast(*this).view().tx();
-    return static_cast<int>(tx_buf.max_size() - tx_buf.size());
+    const auto room = upcast(*this).view().tx().acquire_write().size();
+    return static_cast<int>(room - std::min(room, upcast(*this).staging().bytes.size()));
 }
 
 size_t HardwareSerial::write(uint8_t c) {
     if (!upcast(*this).view().is_active())
         return std::cerr << "HardwareSerial::write(" << static_cast<int>(c) << "): Device inactive" << std::endl, 0;
-    return upcast(*this).view().tx().write({reinterpret_cast<const char*>(&c), 1});
+    return upcast(*this).stage({reinterpret_cast<const char*>(&c), 1});
 }
 
 size_t HardwareSerial::write(const uint8_t* buf, std::size_t n) {
     if (!upcast(*this).view().is_active())
         return std::cerr << "HardwareSerial::write(?, " << n << "): Device inactive" << std::endl, 0;
-    return upcast(*this).view().tx().write({reinterpret_cast<const char*>(buf), n});
+    return upcast(*this).stage({reinterpret_cast<const char*>(buf), n});
 }
 
 int HardwareSerial::peek() {
     if (!upcast(*this).view().is_active())
         return std::cerr << "HardwareSerial::peek(): Device inactive" << std::endl, -1;
+    upcast(*this).publish();
     if (upcast(*this).view().rx().size() < 1)
         return -1;
     return upcast(*this).view().rx().front();
@@ -91,8 +179,34 @@ int HardwareSerial::peek() {
 int HardwareSerial::read() {
     if (!upcast(*this).view().is_active())
         return std::cerr << "HardwareSerial::read(): Device inactive" << std::endl, -1;
+    upcast(*this).publish();
     char ret;
     if (upcast(*this).view().rx().read({&ret, 1}))
         return ret;
     return -1;
-}
\ No newline at end of file
+}
+
+int HardwareSerial::timedRead() {
+    if (!upcast(*this).view().is_active())
+        return std::cerr << "HardwareSerial::timedRead(): Device inactive" << std::endl, -1;
+    upcast(*this).publish(); // the sketch is likely waiting on a reply to what it wrote
+    auto rx_buf = upcast(*this).view().rx();
+    const auto start = millis();
+    char ret;
+    // Sleeps on the rx buffer until the host writes to it, rather than spinning until the timeout (in board time)
+    while (!rx_buf.read({&ret, 1})) {
+        if (static_cast<long>(millis() - start) >= getTimeout())
+            return -1;
+        rx_buf.wait_readable(rx_wait_slice);
+    }
+    return ret;
+}
+
+void HardwareSerial::flush() {
+    if (!upcast(*this).view().is_active())
+        return (void)(std::cerr << "HardwareSerial::flush(): Device inactive" << std::endl);
+    auto& impl = upcast(*this);
+    impl.publish();
+    while (!impl.staging().bytes.empty() && impl.view().tx().wait_writable(flush_timeout))
+        impl.publish();
+}
@@ -24,7 +24,7 @@
 #include "OV767X.h"
 
 namespace smce {
-extern BoardView board_view;
+extern thread_local BoardView board_view;
 extern void maybe_init();
 } // namespace smce
 
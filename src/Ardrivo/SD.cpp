@@ -27,7 +27,7 @@
 #include "SMCE_dll.hpp"
 
 namespace smce {
-extern BoardView board_view;
+extern thread_local BoardView board_view;
 extern void maybe_init();
 } // namespace smce
 
@@ -16,34 +16,216 @@
  *
  */
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <boost/predef.h>
+#if BOOST_OS_LINUX
+extern "C" {
+#    include <fcntl.h>
+#    include <sys/socket.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+}
+#    include <algorithm>
+#    include <array>
+#    include <cerrno>
+#    include <cstring>
+#    include <string>
+#endif
 #include "SMCE/BoardView.hpp"
 #include "SMCE/internal/SharedBoardData.hpp"
 #include "SMCE.hpp"
 
+using namespace std::literals;
+
 namespace smce {
 
 smce::SharedBoardData sbd;
-smce::BoardView board_view;
+thread_local smce::BoardView board_view;
+thread_local BoardData* in_process_board = nullptr; // set on the thread of in-process sketches
+std::mutex in_process_boards_mtx;
+std::vector<BoardData*> in_process_boards; // boards running in-process in this process
+
+/// Thrown through the sketch to unwind it when its in-process board stops it
+struct StopRequest {};
+
+extern void publish_serial_staging() noexcept;
 
+/**
+ * Gives the calling thread a view of its board, if it has none yet
+ *
+ * Sketch processes open the segment handed down by their host. In the host, threads spawned by in-process sketches
+ * themselves get the board running in-process, as long as there is a single one to tell it apart;
+ * they are otherwise left without a view, on which the Arduino API fails instead of crashing.
+ **/
 void maybe_init() {
-    if (sbd.get_board_data())
+    if (board_view.valid())
+        return;
+    if (!std::getenv("SEGNAME") && !std::getenv("SEGFD")) {
+        [[maybe_unused]] std::lock_guard lk{in_process_boards_mtx};
+        if (in_process_boards.size() == 1) {
+            board_view = smce::BoardView{*in_process_boards.front()};
+            return;
+        }
+        thread_local bool reported = false;
+        if (!std::exchange(reported, true))
+            std::fputs("ERROR: Board of the calling thread unknown; threads spawned by in-process sketches can only "
+                       "use the Arduino API while a single board runs in-process\n",
+                       stderr);
         return;
-    const char* segname = std::getenv("SEGNAME");
-    if (!segname)
-        segname = ".";
-    sbd.open_as_child(segname);
-    board_view = smce::BoardView{*sbd.get_board_data()};
+    }
+    static std::once_flag sbd_opened;
+    std::call_once(sbd_opened, [] {
+        try {
+            if (const char* segfd = std::getenv("SEGFD"); segfd && std::atoi(segfd) >= 0)
+                sbd.open_as_child(std::atoi(segfd));
+            else if (const char* segname = std::getenv("SEGNAME"))
+                sbd.open_as_child(segname);
+        } catch (const std::exception&) {
+        }
+        if (!sbd.get_board_data())
+            std::fputs("ERROR: Could not open the board segment\n", stderr);
+    });
+    if (auto* const bd = sbd.get_board_data())
+        board_view = smce::BoardView{*bd};
 }
 
-} // namespace smce
+/**
+ * Honors the run command of the board, for in-process sketches
+ * \throws StopRequest if the sketch is to stop
+ **/
+void checkpoint() {
+    if (!in_process_board)
+        return;
+    auto& command = in_process_board->run_command;
+    while (command.load() == BoardData::RunCommand::suspend)
+        command.wait(BoardData::RunCommand::suspend);
+    if (command.load() == BoardData::RunCommand::stop)
+        throw StopRequest{};
+}
 
-int SMCE__main([[maybe_unused]] int argc, [[maybe_unused]] char** argv, SetupSig* setup, LoopSig* loop) noexcept try {
-    smce::maybe_init();
+/**
+ * Sleeps for some board time, publishing what the sketch staged on its serial channels first
+ *
+ * In-process sketches wait in slices, so that they can be stopped or suspended meanwhile.
+ **/
+void sleep_for(std::chrono::nanoseconds duration) {
+    maybe_init();
+    publish_serial_staging();
+    auto clock = board_view.clock;
+    const auto deadline = clock.now() + duration;
+    if (!in_process_board) {
+        clock.wait_until(deadline);
+        return;
+    }
+    do
+        checkpoint();
+    while (!clock.wait_until(deadline, 1ms));
+    checkpoint();
+}
+
+/**
+ * Blocks a sketch spawned parked until its board releases it
+ * \return whether the sketch should proceed to run
+ **/
+bool maybe_park() {
+    if (!std::getenv("SMCE_PARKED"))
+        return true;
+    return std::getchar() != EOF; // the board writes a byte to release us, and closes the gate when dropping us
+}
+
+/**
+ * Turns this process into a fork-server (zygote) if requested by the host.
+ *
+ * The zygote receives a segment name and the fds to use as stdin and stderr for each sketch to fork,
+ * followed by the memory file of its segment if anonymous.
+ * Sketches are double-forked so that they get orphaned onto the host (a subreaper), which can then wait on them.
+ * \return whether the caller should proceed to run the sketch (false once the zygote is done serving)
+ **/
+bool maybe_serve_forks() {
+#if BOOST_OS_LINUX
+    if (!std::getenv("SMCE_ZYGOTE"))
+        return true;
+    ::unsetenv("SMCE_ZYGOTE");
+
+    constexpr int ctl_fd = STDIN_FILENO;
+    for (;;) {
+        std::array<char, 256> segname{};
+        std::array<int, 3> fds{-1, -1, -1};
+        alignas(::cmsghdr) std::array<char, CMSG_SPACE(sizeof(fds))> ctl_buf{};
+        ::iovec iov{segname.data(), segname.size() - 1};
+        ::msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctl_buf.data();
+        msg.msg_controllen = ctl_buf.size();
+        const auto count = ::recvmsg(ctl_fd, &msg, MSG_CMSG_CLOEXEC);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false; // host hung up
+
+        if (const ::cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            std::memcpy(fds.data(), CMSG_DATA(cmsg), std::min(cmsg->cmsg_len - CMSG_LEN(0), sizeof(fds)));
+
+        std::array<int, 2> pid_pipe{-1, -1};
+        pid_t sketch_pid = -1;
+        if (fds[0] >= 0 && fds[1] >= 0 && ::pipe2(pid_pipe.data(), O_CLOEXEC) == 0) {
+            if (const pid_t intermediate_pid = ::fork(); intermediate_pid == 0) {
+                if (const pid_t pid = ::fork(); pid == 0) {
+                    ::dup2(fds[0], STDIN_FILENO); // also drops the control socket
+                    ::dup2(fds[1], STDERR_FILENO);
+                    for (const int fd : {fds[0], fds[1], pid_pipe[0], pid_pipe[1]})
+                        ::close(fd);
+                    ::setenv("SEGNAME", segname.data(), 1);
+                    ::setenv("SEGFD", std::to_string(fds[2]).c_str(), 1);
+                    return true;
+                } else {
+                    [[maybe_unused]] const auto written = ::write(pid_pipe[1], &pid, sizeof(pid));
+                    ::_exit(EXIT_SUCCESS);
+                }
+            } else if (intermediate_pid > 0) {
+                ::close(pid_pipe[1]);
+                pid_pipe[1] = -1;
+                if (::read(pid_pipe[0], &sketch_pid, sizeof(sketch_pid)) != sizeof(sketch_pid))
+                    sketch_pid = -1;
+                ::waitpid(intermediate_pid, nullptr, 0);
+            }
+        }
+        for (const int fd : {fds[0], fds[1], fds[2], pid_pipe[0], pid_pipe[1]}) {
+            if (fd >= 0)
+                ::close(fd);
+        }
+        const int reply = sketch_pid;
+        ::send(ctl_fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+#else
+    return true;
+#endif
+}
+
+/**
+ * Runs a sketch until it throws
+ * \param prelude - called before the setup; returns whether to go on with running the sketch
+ **/
+template <class Prelude>
+int run_sketch(Prelude prelude, SetupSig* setup, LoopSig* loop) noexcept try {
+    if (!prelude())
+        return EXIT_SUCCESS;
     setup();
-    for (;;)
+    for (;;) {
         loop();
+        publish_serial_staging();
+        checkpoint();
+    }
+} catch (const StopRequest&) {
+    return EXIT_SUCCESS;
 } catch (const std::exception& e) {
     std::fputs("Exception occurred:", stderr);
     std::fputs(e.what(), stderr);
@@ -53,3 +235,30 @@ int SMCE__main([[maybe_unused]] int argc, [[maybe_unused]] char** argv, SetupSig
     std::fputs("Non C++ exception occurred; terminating", stderr);
     return EXIT_FAILURE;
 }
+
+} // namespace smce
+
+int SMCE__main([[maybe_unused]] int argc, [[maybe_unused]] char** argv, SetupSig* setup, LoopSig* loop) noexcept {
+    if (!smce::maybe_serve_forks())
+        return EXIT_SUCCESS;
+    const auto prelude = [] {
+        smce::maybe_init();
+        return smce::maybe_park();
+    };
+    return smce::run_sketch(prelude, setup, loop);
+}
+
+int SMCE__run_in_process(void* board_data, SetupSig* setup, LoopSig* loop) noexcept {
+    auto* const bd = static_cast<smce::BoardData*>(board_data);
+    const auto prelude = [=] {
+        smce::in_process_board = bd;
+        smce::board_view = smce::BoardView{*bd};
+        [[maybe_unused]] std::lock_guard lk{smce::in_process_boards_mtx};
+        smce::in_process_boards.push_back(bd);
+        return true;
+    };
+    const int exit_code = smce::run_sketch(prelude, setup, loop);
+    [[maybe_unused]] std::lock_guard lk{smce::in_process_boards_mtx};
+    std::erase(smce::in_process_boards, bd);
+    return exit_code;
+}
@@ -16,9 +16,18 @@
  */
 
 #include <cctype>
+#include "Arduino.h"
 #include "Stream.h"
 
 void Stream::setTimeout(long timeout) { _timeout = timeout; }
+int Stream::timedRead() {
+    const auto start = millis();
+    do {
+        if (const int c = read(); c >= 0)
+            return c;
+    } while (static_cast<long>(millis() - start) < _timeout);
+    return -1;
+}
 bool Stream::findUntil(const char* target, int length, char terminal) noexcept {
     int count = -1;
     for (;;) {
@@ -121,7 +130,7 @@ long Stream::parseInt(LookaheadMode lookahead, char ignore) {
 size_t Stream::readBytesUntil(char terminator, char* buffer, int length) {
     int index = 0;
     while (index < length) {
-        const int c = read();
+        const int c = timedRead();
         if (c < 0 || c == terminator)
             break;
         *buffer++ = static_cast<char>(c);
@@ -37,28 +37,122 @@ __declspec(dllimport) LONG NTAPI NtSuspendProcess(HANDLE ProcessHandle);
 
 #if BOOST_OS_LINUX
 extern "C" {
-#    include <pthread.h>
+#    include <fcntl.h>
+#    include <sys/epoll.h>
+#    include <sys/syscall.h>
 #    include <unistd.h>
 }
 #    include <array>
+#    include <cerrno>
+#    include <charconv>
+#    include <cstdio>
+#    include <span>
+#    include <string_view>
 #else
 #    include <type_traits>
 #endif
 
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <SMCE/BoardConf.hpp>
+#include <SMCE/BoardPool.hpp>
 #include <SMCE/BoardView.hpp>
+#include <SMCE/ForkServer.hpp>
 #include <SMCE/Toolchain.hpp>
 #include <SMCE/Uuid.hpp>
+#include <SMCE/internal/BoardInternal.hpp>
 #include <SMCE/internal/SharedBoardData.hpp>
 #include <SMCE/internal/utils.hpp>
 #include <boost/process.hpp>
+#include <boost/process/extend.hpp>
 
 namespace bp = boost::process;
 namespace bip = boost::interprocess;
 
+using namespace std::literals;
+
 namespace smce {
 
+namespace {
+/// Wall time an in-process sketch gets to yield once stopped, before being abandoned to its thread
+constexpr auto in_process_stop_timeout = 1s;
+} // namespace
+
+#if BOOST_OS_LINUX
+namespace {
+
+/// Reads a (small) procfs file without allocating
+std::string_view read_proc_file(const char* path, std::span<char> buf) noexcept {
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return {};
+    std::size_t size = 0;
+    while (size < buf.size()) {
+        const auto count = ::read(fd, buf.data() + size, buf.size() - size);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        size += static_cast<std::size_t>(count);
+    }
+    ::close(fd);
+    return {buf.data(), size};
+}
+
+/// Parses the number at the start of a string, after whitespace; 0 if there is none
+std::uint64_t parse_proc_number(std::string_view str) noexcept {
+    const auto begin = str.find_first_not_of(" \t");
+    if (begin == std::string_view::npos)
+        return 0;
+    std::uint64_t ret = 0;
+    std::from_chars(str.data() + begin, str.data() + str.size(), ret);
+    return ret;
+}
+
+/**
+ * Samples the CPU time, resident memory and context switches of a process or thread from procfs
+ * \param dir - the procfs directory of the process or thread (e.g. `/proc/42`)
+ **/
+void sample_proc(const char* dir, Board::Stats& stats) noexcept {
+    std::array<char, 64> path;
+    std::array<char, 4096> buf;
+
+    std::snprintf(path.data(), path.size(), "%s/stat", dir);
+    if (auto stat = read_proc_file(path.data(), buf); stat.find(')') != std::string_view::npos) {
+        // Fields following the command name (which may contain spaces), starting from the state (3rd)
+        stat.remove_prefix(stat.rfind(')') + 1);
+        std::array<std::uint64_t, 22> fields{};
+        for (auto& field : fields) {
+            stat.remove_prefix(std::min(stat.find_first_not_of(' '), stat.size()));
+            field = parse_proc_number(stat);
+            stat.remove_prefix(std::min(stat.find(' '), stat.size()));
+        }
+        static const auto ticks_per_sec = static_cast<std::uint64_t>(::sysconf(_SC_CLK_TCK));
+        static const auto page_size = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+        const auto to_ns = [](std::uint64_t ticks) {
+            return std::chrono::nanoseconds{ticks * 1'000'000'000 / ticks_per_sec};
+        };
+        stats.cpu_user = to_ns(fields[11]);
+        stats.cpu_system = to_ns(fields[12]);
+        stats.rss = fields[21] * page_size;
+    }
+
+    std::snprintf(path.data(), path.size(), "%s/status", dir);
+    const auto status = read_proc_file(path.data(), buf);
+    const auto status_field = [&](std::string_view key) -> std::uint64_t {
+        const auto pos = status.find(key);
+        return pos == std::string_view::npos ? 0 : parse_proc_number(status.substr(pos + key.size()));
+    };
+    stats.voluntary_switches = status_field("\nvoluntary_ctxt_switches:");
+    stats.involuntary_switches = status_field("\nnonvoluntary_ctxt_switches:");
+}
+
+} // namespace
+#endif
+
 // clang-format off
 enum class Board::Command {
     run,      // <==>
@@ -68,18 +162,8 @@ enum class Board::Command {
 };
 // clang-format on
 
-struct Board::Internal {
-    Uuid uuid = Uuid::generate();
-    SharedBoardData sbdata;
-    bp::child sketch;
-    bp::ipstream sketch_log;
-    std::thread sketch_log_grabber;
-};
-
 Board::Board(std::function<void(int)> exit_notify) noexcept
-    : m_exit_notify{std::move(exit_notify)}, m_internal{std::make_unique<Internal>()} {
-    m_runtime_log.reserve(4096);
-}
+    : m_exit_notify{std::move(exit_notify)}, m_internal{std::make_unique<Internal>()} {}
 
 Board::~Board() { do_reap(); }
 
@@ -96,14 +180,28 @@ bool Board::attach_sketch(const Sketch& sketch) noexcept {
     return true;
 }
 
+bool Board::attach_pool(BoardPool* pool) noexcept {
+    if (m_status == Status::running || m_status == Status::suspended)
+        return false;
+    m_pool = pool;
+    return true;
+}
+
+bool Board::attach_fork_server(ForkServer* fork_server) noexcept {
+    if (m_status == Status::running || m_status == Status::suspended)
+        return false;
+    m_fork_server = fork_server;
+    return true;
+}
+
 void Board::tick() noexcept {
     switch (m_status) {
     case Status::running:
     case Status::suspended: {
         auto& in = *m_internal;
-        if (!in.sketch.running()) {
-            const auto exit_code = m_internal->sketch.exit_code();
-            do_sweep();
+        const bool event_driven = in.sketch_module.is_loaded() || in.sketch_exit_watch;
+        if (event_driven ? in.sketch_exited.load() : !in.sketch.running()) {
+            const auto exit_code = do_sweep();
             m_status = Status::stopped;
             if (m_exit_notify)
                 m_exit_notify(exit_code);
@@ -121,6 +219,8 @@ bool Board::reset() noexcept {
     default:
         do_reap();
         m_sketch_ptr = nullptr;
+        m_pool = nullptr;
+        m_fork_server = nullptr;
         m_conf_opt = std::nullopt;
         m_internal = std::make_unique<Internal>();
         m_runtime_log.clear();
@@ -144,7 +244,13 @@ bool Board::start() noexcept {
     if (!m_sketch_ptr || !m_sketch_ptr->is_compiled())
         return false;
 
-    do_spawn();
+    const auto start_time = std::chrono::steady_clock::now();
+    const bool pool_hit = m_pool && m_pool->take(*this);
+    if (!pool_hit && !do_spawn())
+        return false;
+    do_release();
+    if (m_pool)
+        m_pool->record_start(pool_hit, std::chrono::steady_clock::now() - start_time);
 
     m_status = Status::running;
     return true;
@@ -154,6 +260,13 @@ bool Board::suspend() noexcept {
     if (m_status != Status::running)
         return false;
 
+    if (m_internal->sketch_module.is_loaded()) {
+        auto& command = m_internal->sbdata.get_board_data()->run_command;
+        command = BoardData::RunCommand::suspend;
+        m_status = Status::suspended;
+        return true;
+    }
+
 #if defined(__unix__)
     ::kill(m_internal->sketch.native_handle(), SIGSTOP);
 #elif defined(_WIN32) || defined(WIN32)
@@ -168,6 +281,14 @@ bool Board::resume() noexcept {
     if (m_status != Status::suspended)
         return false;
 
+    if (m_internal->sketch_module.is_loaded()) {
+        auto& command = m_internal->sbdata.get_board_data()->run_command;
+        command = BoardData::RunCommand::run;
+        command.notify_all();
+        m_status = Status::running;
+        return true;
+    }
+
 #if defined(__unix__)
     ::kill(m_internal->sketch.native_handle(), SIGCONT);
 #elif defined(_WIN32) || defined(WIN32)
@@ -209,24 +330,154 @@ bool BoardRunner::stop() noexcept {
 // FIXME
 bool Board::stop() noexcept { return terminate(); }
 
+[[nodiscard]] auto Board::stats() noexcept -> Stats {
+    Stats ret;
+    ret.log_bytes = m_runtime_log.end();
+    if (m_status != Status::running && m_status != Status::suspended)
+        return ret;
+
+    auto& in = *m_internal;
+    ret.uptime = std::chrono::steady_clock::now() - in.sketch_start_time;
+    ret.shm_size = in.sbdata.segment_size();
+    ret.shm_used = in.sbdata.segment_used();
+#if BOOST_OS_LINUX
+    std::array<char, 48> dir;
+    if (!in.sketch_module.is_loaded()) {
+        std::snprintf(dir.data(), dir.size(), "/proc/%d", static_cast<int>(in.sketch.id()));
+        sample_proc(dir.data(), ret);
+    } else if (const int tid = in.sketch_tid; tid != 0) {
+        std::snprintf(dir.data(), dir.size(), "/proc/self/task/%d", tid);
+        sample_proc(dir.data(), ret);
+        ret.rss = 0; // that of the host
+    }
+#endif
+    return ret;
+}
+
 /**
- * Spawns the child process and its log grabber
+ * Creates the shared segment of a sketch and spawns it parked (i.e. blocked before its setup)
  **/
-void Board::do_spawn() noexcept {
-    auto hex_uuid = m_internal->uuid.to_hex();
-    m_internal->sbdata.configure("SMCE-Runner-" + hex_uuid, *m_conf_opt);
+bool Board::do_prespawn(Internal& in, const Sketch& sketch, const BoardConfig& bconf,
+                        [[maybe_unused]] ForkServer* fork_server) noexcept try {
+    if (sketch.m_conf.in_process)
+        return false;
+    const auto segname = "SMCE-Runner-" + in.uuid.to_hex();
+    in.sbdata.configure(segname, bconf);
+    const int seg_fd = in.sbdata.segment_fd();
+
+#if BOOST_OS_LINUX
+    if (fork_server && &fork_server->sketch() == &sketch && fork_server->valid()) {
+        auto& gate = in.sketch_gate.pipe();
+        auto& log = in.sketch_log.pipe();
+        if (int pid = fork_server->fork(segname, gate.native_source(), log.native_sink(), seg_fd); pid > 0) {
+            // The sketch got its own copies of the child ends
+            ::close(gate.native_source());
+            gate.assign_source(-1);
+            ::close(log.native_sink());
+            log.assign_sink(-1);
+            in.sketch = bp::child{bp::child::child_handle{pid}};
+            return true;
+        }
+    }
+#endif
 
     // clang-format off
-    m_internal->sketch = bp::child{
-        bp::env["SEGNAME"] = "SMCE-Runner-" + hex_uuid,
-        "\"" + m_sketch_ptr->m_executable.string() + "\"",
+    in.sketch = bp::child{
+        bp::env["SEGNAME"] = segname,
+        bp::env["SEGFD"] = std::to_string(seg_fd),
+        bp::env["SMCE_PARKED"] = "1",
+        "\"" + sketch.m_executable.string() + "\"",
+        bp::std_in < in.sketch_gate,
         bp::std_out > bp::null,
-        bp::std_err > m_internal->sketch_log
+        bp::std_err > in.sketch_log
 #if BOOST_OS_WINDOWS
         , bp::windows::create_no_window
+#elif BOOST_OS_LINUX
+        , bp::extend::on_exec_setup = [=](auto&) {
+            if (seg_fd >= 0)
+                ::fcntl(seg_fd, F_SETFD, 0); // inherited by the sketch only
+        }
 #endif
     };
     // clang-format on
+    return true;
+} catch (const std::exception&) {
+    return false;
+}
+
+/**
+ * Creates the heap segment of an in-process sketch and loads its module
+ **/
+bool Board::do_load(Internal& in, const Sketch& sketch, const BoardConfig& bconf) noexcept try {
+    in.sbdata.configure_in_process(bconf);
+    in.sketch_module_copy = sketch.m_executable;
+    in.sketch_module_copy.replace_filename("Sketch-" + in.uuid.to_hex() +
+                                           boost::dll::shared_library::suffix().string());
+    stdfs::copy_file(sketch.m_executable, in.sketch_module_copy, stdfs::copy_options::overwrite_existing);
+    in.sketch_module.load(in.sketch_module_copy.string());
+    if (!in.sketch_module.has("SMCE__sketch_entry")) {
+        do_unload(in);
+        return false;
+    }
+    return true;
+} catch (const std::exception&) {
+    do_unload(in);
+    return false;
+}
+
+/**
+ * Unloads the module of an in-process sketch whose thread is gone
+ **/
+void Board::do_unload(Internal& in) noexcept {
+    in.sketch_module.unload();
+    if (!in.sketch_module_copy.empty()) {
+        [[maybe_unused]] std::error_code ignored;
+        stdfs::remove(in.sketch_module_copy, ignored);
+        in.sketch_module_copy.clear();
+    }
+}
+
+/**
+ * Spawns the child process, or loads the sketch module if running in-process
+ **/
+bool Board::do_spawn() noexcept {
+    auto internal = std::make_unique<Internal>();
+    const bool spawned = m_sketch_ptr->m_conf.in_process
+                             ? do_load(*internal, *m_sketch_ptr, *m_conf_opt)
+                             : do_prespawn(*internal, *m_sketch_ptr, *m_conf_opt, m_fork_server);
+    if (!spawned)
+        return false;
+    m_internal = std::move(internal);
+    return true;
+}
+
+/**
+ * Lets a parked sketch run its setup and has its log drained, or starts the thread of an in-process sketch
+ **/
+void Board::do_release() noexcept {
+    BoardView{*m_internal->sbdata.get_board_data()}.clock.reset(); // board time starts with the sketch
+    m_internal->sketch_start_time = std::chrono::steady_clock::now();
+    if (m_internal->sketch_module.is_loaded()) {
+        auto& in = *m_internal;
+        const auto entry = in.sketch_module.get<int(void*)>("SMCE__sketch_entry");
+        in.sketch_thread = std::thread{[&in, entry] {
+#if BOOST_OS_LINUX
+            in.sketch_tid = static_cast<int>(::syscall(SYS_gettid));
+#endif
+            in.sketch_exit_code = entry(in.sbdata.get_board_data());
+            // Notified under the lock, as the board may go away as soon as a reaper sees the sketch exited
+            [[maybe_unused]] std::lock_guard lk{in.sketch_exit_mtx};
+            in.sketch_exited = true;
+            in.sketch_exit_cv.notify_all();
+        }};
+        return;
+    }
+
+    m_internal->sketch_gate << '\n' << std::flush;
+    m_internal->sketch_gate.pipe().close();
+    m_internal->watch_exit(m_reactor ? *m_reactor : Reactor::shared());
+    if (do_watch_log())
+        return;
 
     m_internal->sketch_log_grabber = std::thread{[&] {
         auto& stream = m_internal->sketch_log;
@@ -245,10 +496,7 @@ void Board::do_spawn() noexcept {
                 else
                     break;
             }
-            [[maybe_unused]] std::lock_guard lk{m_runtime_log_mtx};
-            const auto existing = m_runtime_log.size();
-            m_runtime_log.resize(existing + count);
-            std::memcpy(m_runtime_log.data() + existing, buf.data(), count);
+            m_runtime_log.write({buf.data(), static_cast<std::size_t>(count)});
         }
 #else
         std::string buf;
@@ -257,13 +505,10 @@ void Board::do_spawn() noexcept {
             const int head = stream.get();
             if (head == std::remove_cvref_t<decltype(stream)>::traits_type::eof())
                 break;
-            buf.resize(stream.rdbuf()->in_avail());
-            const auto count = stream.readsome(buf.data(), buf.size());
-            [[maybe_unused]] std::lock_guard lk{m_runtime_log_mtx};
-            const auto existing = m_runtime_log.size();
-            m_runtime_log.resize(existing + count + 1);
-            m_runtime_log[existing] = static_cast<char>(head);
-            std::memcpy(m_runtime_log.data() + existing + 1, buf.data(), count);
+            buf.resize(stream.rdbuf()->in_avail() + 1);
+            buf[0] = static_cast<char>(head);
+            const auto count = stream.readsome(buf.data() + 1, buf.size() - 1);
+            m_runtime_log.write({buf.data(), static_cast<std::size_t>(count) + 1});
         }
 #endif
         stream.pipe().close();
@@ -272,14 +517,24 @@ void Board::do_spawn() noexcept {
 
 /**
  * Cleans up after a suicidal sketch
+ * \return the exit code of the sketch
  **/
-void Board::do_sweep() noexcept {
+int Board::do_sweep() noexcept {
     auto& in = *m_internal;
+    if (in.sketch_module.is_loaded()) {
+        in.sketch_thread.join();
+        do_unload(in);
+        return in.sketch_exit_code;
+    }
+    in.unwatch_exit();
     [[maybe_unused]] std::error_code ignored;
     in.sketch.wait(ignored);
+    const int exit_code = in.sketch.exit_code();
     in.sketch = bp::child{}; // clear pid
+    do_unwatch_log();
     if (in.sketch_log_grabber.joinable())
         in.sketch_log_grabber.join();
+    return exit_code;
 }
 
 /**
@@ -290,17 +545,130 @@ void Board::do_reap() noexcept {
         return;
     auto& in = *m_internal;
 
+    if (in.sketch_module.is_loaded()) {
+        if (in.sketch_thread.joinable()) {
+            auto& command = in.sbdata.get_board_data()->run_command;
+            command = BoardData::RunCommand::stop;
+            command.notify_all();
+            BoardView{*in.sbdata.get_board_data()}.clock.advance(0ns); // wakes it up if waiting on a stepped clock
+            std::unique_lock lk{in.sketch_exit_mtx};
+            if (!in.sketch_exit_cv.wait_for(lk, in_process_stop_timeout, [&] { return in.sketch_exited.load(); })) {
+                // The sketch does not yield; leave it its module and board data for as long as it runs
+                lk.unlock();
+                constexpr std::string_view note = "[SMCE] In-process sketch did not stop; abandoned to its thread, "
+                                                  "along with its module and board data\n";
+                m_runtime_log.write(note);
+                in.sketch_thread.detach();
+                (void)m_internal.release();
+                m_internal = std::make_unique<Internal>();
+                return;
+            }
+            lk.unlock();
+            in.sketch_thread.join();
+        }
+        do_unload(in);
+        return;
+    }
+
+    in.unwatch_exit();
     [[maybe_unused]] std::error_code ignored;
     in.sketch.terminate(ignored);
     in.sketch.wait(ignored);
     in.sketch = bp::child{}; // clear pid
-    if (in.sketch_log_grabber.joinable()) {
+    do_unwatch_log();
+    if (in.sketch_log_grabber.joinable())
+        in.sketch_log_grabber.join(); // the pipe hit eof with the death of the sketch
+}
+
+/**
+ * Has the reactor drain the log pipe of the sketch into the runtime log, sparing a grabber thread per board
+ * \return whether the reactor took over the log
+ **/
+bool Board::do_watch_log() noexcept {
 #if BOOST_OS_LINUX
-        ::pthread_cancel(in.sketch_log_grabber.native_handle());
-        in.sketch_log.pipe().close();
+    auto& in = *m_internal;
+    const int fd = in.sketch_log.pipe().native_source();
+    const int flags = ::fcntl(fd, F_GETFL);
+    if (flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+        return false;
+    in.sketch_log_watch = in.reactor->add(fd, EPOLLIN, [this, fd](std::uint32_t) {
+        std::array<char, 4096> buf;
+        for (;;) {
+            const auto count = ::read(fd, buf.data(), buf.size());
+            if (count > 0) {
+                m_runtime_log.write({buf.data(), static_cast<std::size_t>(count)});
+                continue;
+            }
+            if (count == -1 && errno == EINTR)
+                continue;
+            return count == -1 && errno == EAGAIN; // keep watching until eof
+        }
+    });
+    if (!in.sketch_log_watch) {
+        ::fcntl(fd, F_SETFL, flags);
+        return false;
+    }
+    return true;
+#else
+    return false;
 #endif
-        in.sketch_log_grabber.join();
+}
+
+/**
+ * Stops draining the log pipe of the sketch through the reactor, collecting what is left in it
+ **/
+void Board::do_unwatch_log() noexcept {
+    auto& in = *m_internal;
+    if (!in.sketch_log_watch)
+        return;
+    in.reactor->remove(in.sketch_log_watch);
+    in.sketch_log_watch = {};
+#if BOOST_OS_LINUX
+    const int fd = in.sketch_log.pipe().native_source();
+    std::array<char, 4096> buf;
+    for (;;) {
+        const auto count = ::read(fd, buf.data(), buf.size());
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        m_runtime_log.write({buf.data(), static_cast<std::size_t>(count)});
+    }
+#endif
+    in.sketch_log.pipe().close();
+}
+
+/**
+ * Has a reactor flag the exit of the sketch process, sparing `tick` from polling it
+ **/
+void Board::Internal::watch_exit(Reactor& watcher) noexcept {
+    reactor = &watcher;
+#if BOOST_OS_LINUX && defined(SYS_pidfd_open)
+    sketch_pidfd = static_cast<int>(::syscall(SYS_pidfd_open, sketch.id(), 0));
+    if (sketch_pidfd < 0)
+        return; // pre-5.3 kernel
+    sketch_exit_watch = reactor->add(sketch_pidfd, EPOLLIN, [this](std::uint32_t) {
+        sketch_exited = true;
+        return false;
+    });
+    if (!sketch_exit_watch) {
+        ::close(sketch_pidfd);
+        sketch_pidfd = -1;
     }
+#endif
+}
+
+void Board::Internal::unwatch_exit() noexcept {
+    if (sketch_exit_watch) {
+        reactor->remove(sketch_exit_watch);
+        sketch_exit_watch = {};
+    }
+#if BOOST_OS_LINUX
+    if (sketch_pidfd >= 0) {
+        ::close(sketch_pidfd);
+        sketch_pidfd = -1;
+    }
+#endif
 }
 
 } // namespace smce
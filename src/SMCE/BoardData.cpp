@@ -18,21 +18,351 @@
 
 #include "SMCE/internal/BoardData.hpp"
 
+#if BOOST_OS_LINUX
+extern "C" {
+#    include <fcntl.h>
+#    include <linux/futex.h>
+#    include <sys/syscall.h>
+}
+#    include <array>
+#    include <cstdio>
+#endif
+#if BOOST_OS_WINDOWS
+#    include <process.h>
+#else
+extern "C" {
+#    include <signal.h>
+#    include <unistd.h>
+}
+#    include <cerrno>
+#endif
+#if BOOST_ARCH_X86
+#    include <immintrin.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <thread>
 #include "SMCE/BoardConf.hpp"
 
 namespace bip = boost::interprocess;
 
 namespace smce {
 
-BoardData::UartChannel::UartChannel(const ShmAllocator<void>& shm_valloc) : rx{shm_valloc}, tx{shm_valloc} {}
+namespace {
+
+template <class T>
+using RingStorage = boost::interprocess::vector<T, ShmAllocator<T>>;
+
+/// Copies elements out of a ring's storage, starting at a stream position
+template <class T>
+void copy_from_ring(const RingStorage<T>& data, std::uint32_t pos, std::span<T> out) noexcept {
+    if (out.empty())
+        return;
+    const auto offset = pos & (data.size() - 1);
+    const auto first_size = std::min(out.size(), data.size() - offset);
+    std::memcpy(out.data(), data.data() + offset, first_size * sizeof(T));
+    std::memcpy(out.data() + first_size, data.data(), (out.size() - first_size) * sizeof(T));
+}
+
+/// Copies elements into a ring's storage, starting at a stream position
+template <class T>
+void copy_to_ring(RingStorage<T>& data, std::uint32_t pos, std::span<const T> in) noexcept {
+    if (in.empty())
+        return;
+    const auto offset = pos & (data.size() - 1);
+    const auto first_size = std::min(in.size(), data.size() - offset);
+    std::memcpy(data.data() + offset, in.data(), first_size * sizeof(T));
+    std::memcpy(data.data(), in.data() + first_size, (in.size() - first_size) * sizeof(T));
+}
+
+/// Splits elements of a ring's storage from a stream position into those up to its end and those wrapped around
+template <class T>
+std::array<std::span<T>, 2> ring_segments(std::span<T> data, std::uint32_t pos, std::size_t count) noexcept {
+    const auto offset = pos & (data.size() - 1);
+    const auto first_size = std::min(count, data.size() - offset);
+    return {data.subspan(offset, first_size), data.first(count - first_size)};
+}
+
+using FutexWord = IpcAtomicValue<std::uint32_t>;
+
+/// Blocks until a word (possibly) changed away from a value, or for at most some time
+void futex_wait(FutexWord& word, std::uint32_t value, std::chrono::nanoseconds timeout) noexcept {
+#if BOOST_OS_LINUX
+    static_assert(sizeof(word) == sizeof(std::uint32_t));
+    const auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    const ::timespec ts{static_cast<::time_t>(secs.count()), static_cast<long>((timeout - secs).count())};
+    // Not FUTEX_PRIVATE_FLAG, as the other side is usually another process
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, value, &ts, nullptr, 0);
+#else
+    (void)word;
+    (void)value;
+    std::this_thread::sleep_for(std::min(timeout, std::chrono::nanoseconds{std::chrono::microseconds{100}}));
+#endif
+}
+
+/// Wakes up to `count` of those blocked on a word
+void futex_wake([[maybe_unused]] FutexWord& word, [[maybe_unused]] int count) noexcept {
+#if BOOST_OS_LINUX
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+#endif
+}
+
+/// Wakes up everyone waiting on a ring counter to move, if anyone is
+void notify_move(FutexWord& counter, FutexWord& waiters) noexcept {
+    std::atomic_thread_fence(std::memory_order_seq_cst); // orders the move before checking for waiters
+    if (waiters.load(boost::memory_order_relaxed) != 0)
+        futex_wake(counter, INT_MAX);
+}
+
+/**
+ * Blocks until a ring becomes ready, waiting on its counter moved by the other side
+ * \param ready - whether the ring is ready; rechecked whenever the counter moves
+ **/
+template <class Ready>
+bool wait_on(FutexWord& counter, FutexWord& waiters,
+             std::chrono::nanoseconds timeout, Ready ready) noexcept {
+    using namespace std::chrono_literals;
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        const std::uint32_t value = counter.load();
+        if (ready())
+            return true;
+        const auto remaining = timeout - (std::chrono::steady_clock::now() - start);
+        if (remaining <= 0ns)
+            return false;
+        waiters.fetch_add(1);
+        if (counter.load() == value)
+            futex_wait(counter, value, std::min<std::chrono::nanoseconds>(remaining, 1s));
+        waiters.fetch_sub(1);
+    }
+}
+
+/// Hints the CPU that we are spinning
+void cpu_relax() noexcept {
+#if BOOST_ARCH_X86
+    _mm_pause();
+#endif
+}
+
+std::int32_t current_pid() noexcept {
+#if BOOST_OS_WINDOWS
+    return ::_getpid();
+#else
+    return ::getpid();
+#endif
+}
+
+#if BOOST_OS_LINUX
+/// Whether a process exited but was not reaped yet, as a crashed sketch is until its board gets ticked
+bool process_zombie(std::int32_t pid) noexcept {
+    std::array<char, 32> path{};
+    std::snprintf(path.data(), path.size(), "/proc/%d/stat", static_cast<int>(pid));
+    const int fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    // "pid (comm) state ...", where comm may hold anything, parentheses included
+    std::array<char, 512> stat{};
+    const auto count = ::read(fd, stat.data(), stat.size() - 1);
+    ::close(fd);
+    if (count <= 0)
+        return false;
+    const char* const comm_end = std::strrchr(stat.data(), ')');
+    return comm_end && comm_end[1] == ' ' && (comm_end[2] == 'Z' || comm_end[2] == 'X');
+}
+#endif
+
+/// Whether a process is (still) running; always assumed to be where this cannot be told
+bool process_alive([[maybe_unused]] std::int32_t pid) noexcept {
+#if BOOST_OS_WINDOWS
+    return true;
+#elif BOOST_OS_LINUX
+    // Zombies still answer signals, yet will never unlock anything
+    return (::kill(pid, 0) == 0 || errno != ESRCH) && !process_zombie(pid);
+#else
+    return ::kill(pid, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+} // namespace
+
+bool IpcMovableMutex::try_lock() noexcept {
+    std::uint32_t expected = unlocked;
+    if (!state.compare_exchange_strong(expected, locked, boost::memory_order_acquire, boost::memory_order_relaxed))
+        return false;
+    owner.store(current_pid(), boost::memory_order_relaxed);
+    return true;
+}
+
+void IpcMovableMutex::lock() noexcept {
+    for (int i = 0; i < spin_count; ++i) {
+        if (state.load(boost::memory_order_relaxed) == unlocked && try_lock())
+            return;
+        cpu_relax();
+    }
+    // Marks the lock as contended so that its owner wakes us up when done
+    while (state.exchange(contended, boost::memory_order_acquire) != unlocked) {
+        futex_wait(state, contended, owner_check_period);
+        // The owner may be gone without unlocking; whoever notices first takes over
+        if (auto pid = owner.load(boost::memory_order_relaxed); pid != 0 && !process_alive(pid) &&
+                                                                 owner.compare_exchange_strong(pid, current_pid()))
+            return;
+    }
+    owner.store(current_pid(), boost::memory_order_relaxed);
+}
+
+void IpcMovableMutex::unlock() noexcept {
+    owner.store(0, boost::memory_order_relaxed);
+    if (state.exchange(unlocked, boost::memory_order_release) == contended)
+        futex_wake(state, 1);
+}
+
+template <class T>
+std::size_t BoardData::Ring<T>::storage_size(std::uint16_t cap, bool observable) noexcept {
+    return (observable ? 2 : 1) * std::bit_ceil(std::max<std::size_t>(cap, 1));
+}
+
+template <class T>
+BoardData::Ring<T>::Ring(const ShmAllocator<void>& shm_valloc, std::uint16_t cap, bool observable)
+    : capacity{cap}, data(storage_size(cap, observable), shm_valloc) {}
+
+template <class T>
+[[nodiscard]] std::size_t BoardData::Ring<T>::size() const noexcept {
+    const std::uint32_t h = head.load(boost::memory_order_acquire);
+    const std::uint32_t t = tail.load(boost::memory_order_acquire);
+    return std::min<std::size_t>(t - h, capacity);
+}
+
+template <class T>
+std::size_t BoardData::Ring<T>::read(std::span<T> buf) noexcept {
+    const std::uint32_t h = head.load(boost::memory_order_relaxed);
+    const std::uint32_t t = tail.load(boost::memory_order_acquire);
+    const auto count = std::min<std::size_t>(t - h, buf.size());
+    copy_from_ring(data, h, buf.first(count));
+    head.store(h + static_cast<std::uint32_t>(count), boost::memory_order_release);
+    if (count)
+        notify_move(head, head_waiters);
+    return count;
+}
+
+template <class T>
+std::size_t BoardData::Ring<T>::write(std::span<const T> buf) noexcept {
+    const std::uint32_t t = tail.load(boost::memory_order_relaxed);
+    const std::uint32_t h = head.load(boost::memory_order_acquire);
+    const auto count = std::min<std::size_t>(capacity - std::min<std::size_t>(t - h, capacity), buf.size());
+    copy_to_ring(data, t, buf.first(count));
+    tail.store(t + static_cast<std::uint32_t>(count), boost::memory_order_release);
+    if (count)
+        notify_move(tail, tail_waiters);
+    return count;
+}
+
+template <class T>
+std::size_t BoardData::Ring<T>::peek(std::span<T> buf) const noexcept {
+    for (;;) {
+        const std::uint32_t h = head.load(boost::memory_order_acquire);
+        const std::uint32_t t = tail.load(boost::memory_order_acquire);
+        const auto count = std::min({std::size_t{t - h}, std::size_t{capacity}, buf.size()});
+        copy_from_ring(data, h, buf.first(count));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (head.load(boost::memory_order_relaxed) == h)
+            return count; // the producer cannot have overwritten what was copied
+    }
+}
+
+template <class T>
+std::size_t BoardData::Ring<T>::snoop(std::uint32_t& pos, std::span<T> buf, std::size_t& lost) const noexcept {
+    const std::uint32_t t = tail.load(boost::memory_order_acquire);
+    // The oldest elements still in storage, as the producer reuses a slot once the consumer moved past it
+    lost = (t - pos > data.size()) ? t - pos - data.size() : 0;
+    pos += static_cast<std::uint32_t>(lost);
+    const auto count = std::min(std::size_t{t - pos}, buf.size());
+    copy_from_ring(data, pos, buf.first(count));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // The producer may have written up to a capacity past the head meanwhile, reusing the slots of older elements
+    const std::uint32_t intact_from = head.load(boost::memory_order_relaxed) + capacity - data.size();
+    const auto behind = std::max(static_cast<std::int32_t>(intact_from - pos), std::int32_t{0});
+    const auto clobbered = std::min(static_cast<std::size_t>(behind), count);
+    if (clobbered != 0)
+        std::memmove(buf.data(), buf.data() + clobbered, (count - clobbered) * sizeof(T));
+    lost += clobbered;
+    pos += static_cast<std::uint32_t>(count);
+    return count - clobbered;
+}
+
+template <class T>
+std::array<std::span<const T>, 2> BoardData::Ring<T>::readable() const noexcept {
+    const std::uint32_t h = head.load(boost::memory_order_relaxed);
+    const std::uint32_t t = tail.load(boost::memory_order_acquire);
+    return ring_segments(std::span<const T>{data.data(), data.size()}, h, t - h);
+}
+
+template <class T>
+std::size_t BoardData::Ring<T>::consume(std::size_t count) noexcept {
+    const std::uint32_t h = head.load(boost::memory_order_relaxed);
+    count = std::min<std::size_t>(count, tail.load(boost::memory_order_acquire) - h);
+    if (count == 0)
+        return 0;
+    head.store(h + static_cast<std::uint32_t>(count), boost::memory_order_release);
+    notify_move(head, head_waiters);
+    return count;
+}
+
+template <class T>
+std::array<std::span<T>, 2> BoardData::Ring<T>::writable() noexcept {
+    const std::uint32_t t = tail.load(boost::memory_order_relaxed);
+    const std::uint32_t h = head.load(boost::memory_order_acquire);
+    return ring_segments(std::span<T>{data.data(), data.size()}, t,
+                         capacity - std::min<std::size_t>(t - h, capacity));
+}
+
+template <class T>
+std::size_t BoardData::Ring<T>::commit(std::size_t count) noexcept {
+    const std::uint32_t t = tail.load(boost::memory_order_relaxed);
+    const std::uint32_t h = head.load(boost::memory_order_acquire);
+    count = std::min<std::size_t>(count, capacity - std::min<std::size_t>(t - h, capacity));
+    if (count == 0)
+        return 0;
+    tail.store(t + static_cast<std::uint32_t>(count), boost::memory_order_release);
+    notify_move(tail, tail_waiters);
+    return count;
+}
+
+template <class T>
+bool BoardData::Ring<T>::wait_readable(std::chrono::nanoseconds timeout) noexcept {
+    return wait_on(tail, tail_waiters, timeout, [&] { return size() != 0; });
+}
+
+template <class T>
+bool BoardData::Ring<T>::wait_writable(std::chrono::nanoseconds timeout) noexcept {
+    return wait_on(head, head_waiters, timeout, [&] { return size() < capacity; });
+}
+
+template <class T>
+bool BoardData::Ring<T>::wait_enqueued(std::uint32_t pos, std::chrono::nanoseconds timeout) noexcept {
+    return wait_on(tail, tail_waiters, timeout, [&] { return tail.load(boost::memory_order_acquire) != pos; });
+}
+
+template struct BoardData::Ring<char>;
+template struct BoardData::Ring<BoardData::PinEvent>;
+
+BoardData::UartChannel::UartChannel(const ShmAllocator<void>& shm_valloc, std::uint16_t rx_capacity,
+                                    std::uint16_t tx_capacity, bool recordable)
+    : rx{shm_valloc, rx_capacity, recordable}, tx{shm_valloc, tx_capacity, recordable}, recordable{recordable} {}
 
 BoardData::DirectStorage::DirectStorage(const ShmAllocator<void>& shm_valloc) : root_dir{shm_valloc} {}
 
 BoardData::FrameBuffer::FrameBuffer(const ShmAllocator<void>& shm_valloc) : data{shm_valloc} {}
 
 BoardData::BoardData(const ShmAllocator<void>& shm_valloc, const BoardConfig& c) noexcept
-    : pins{shm_valloc}, uart_channels{shm_valloc}, direct_storages{shm_valloc}, frame_buffers{shm_valloc} {
+    : pins{shm_valloc}, pin_indices{shm_valloc}, pin_values{shm_valloc}, uart_channels{shm_valloc},
+      direct_storages{shm_valloc}, frame_buffers{shm_valloc},
+      pin_events{shm_valloc,
+                 static_cast<std::uint16_t>(std::min(c.pin_event_capacity, BoardConfig::max_pin_event_capacity))} {
     auto sorted_pins = c.pins;
     std::sort(sorted_pins.begin(), sorted_pins.end());
 
@@ -41,6 +371,10 @@ BoardData::BoardData(const ShmAllocator<void>& shm_valloc, const BoardConfig& c)
         auto& pin_obj = pins.emplace_back();
         pin_obj.id = pin_id;
     }
+    if (!sorted_pins.empty())
+        pin_indices.resize(std::size_t{sorted_pins.back()} + 1, no_pin);
+    for (std::size_t i = pins.size(); i-- > 0;)
+        pin_indices[pins[i].id] = static_cast<std::uint16_t>(i); // first of duplicate ids wins, as with a search
 
     for (const auto& gpio_driver : c.gpio_drivers) {
         const auto it = std::find(sorted_pins.begin(), sorted_pins.end(), gpio_driver.pin_id);
@@ -60,14 +394,27 @@ BoardData::BoardData(const ShmAllocator<void>& shm_valloc, const BoardConfig& c)
         }
     }
 
+    const auto host_written = [](const Pin& pin) {
+        return (pin.can_digital_read || pin.can_analog_read) && !pin.can_digital_write && !pin.can_analog_write;
+    };
+    constexpr std::size_t padding = cache_line_size / sizeof(PinValue);
+    const auto host_written_count = static_cast<std::size_t>(std::count_if(pins.begin(), pins.end(), host_written));
+    pin_values.resize(padding + host_written_count + padding + (pins.size() - host_written_count) + padding);
+    auto host_slot = padding;
+    auto sketch_slot = padding + host_written_count + padding;
+    for (auto& pin : pins)
+        pin.value_slot = static_cast<std::uint16_t>(host_written(pin) ? host_slot++ : sketch_slot++);
+
     uart_channels.reserve(c.uart_channels.size());
     for (const auto& conf : c.uart_channels) {
-        auto& data = uart_channels.emplace_back(shm_valloc);
+        auto& data = uart_channels.emplace_back(shm_valloc, static_cast<std::uint16_t>(conf.rx_buffer_length),
+                                                static_cast<std::uint16_t>(conf.tx_buffer_length), conf.recordable);
         data.baud_rate = conf.baud_rate;
+        data.paced = conf.paced;
+        data.flushing_threshold =
+            static_cast<std::uint16_t>(std::min(conf.flushing_threshold, std::size_t{data.tx.capacity}));
         data.rx_pin_override = conf.rx_pin_override;
         data.tx_pin_override = conf.tx_pin_override;
-        data.max_buffered_rx = static_cast<std::uint16_t>(conf.rx_buffer_length);
-        data.max_buffered_tx = static_cast<std::uint16_t>(conf.tx_buffer_length);
     }
 
     direct_storages.reserve(c.sd_cards.size());
@@ -86,7 +433,14 @@ BoardData::BoardData(const ShmAllocator<void>& shm_valloc, const BoardConfig& c)
         auto& data = frame_buffers.emplace_back(shm_valloc);
         data.key = conf.key;
         data.direction = BoardData::FrameBuffer::Direction{static_cast<std::uint8_t>(conf.direction)};
+        // Claimed upfront so that resizing up to the maximum resolution never needs to reallocate
+        data.data.reserve(std::size_t{conf.max_width} * conf.max_height * 3);
     }
+
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    clock.wall_origin = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    clock.speed_factor = c.clock_speed_factor >= 0 ? c.clock_speed_factor : 1.0;
+    prefault = c.shared_segment.prefault;
 }
 
 } // namespace smce
\ No newline at end of file
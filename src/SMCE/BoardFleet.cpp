@@ -0,0 +1,109 @@
+/*
+ *  BoardFleet.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <SMCE/BoardFleet.hpp>
+#include <SMCE/internal/Reactor.hpp>
+
+namespace smce {
+
+BoardFleet::BoardFleet(std::function<void(std::size_t, int)> exit_notify) noexcept
+    : m_exit_notify{std::move(exit_notify)}, m_reactor{std::make_unique<Reactor>()} {}
+
+BoardFleet::~BoardFleet() {
+    m_boards.clear(); // boards unwatch their sketches from the reactor
+}
+
+std::size_t BoardFleet::add(std::size_t count) {
+    const auto first = m_boards.size();
+    m_boards.reserve(first + count);
+    for (auto idx = first; idx < first + count; ++idx) {
+        auto& board = *m_boards.emplace_back(std::make_unique<Board>([this, idx](int exit_code) {
+            ++m_exits;
+            if (m_exit_notify)
+                m_exit_notify(idx, exit_code);
+        }));
+        if (m_reactor->valid())
+            board.m_reactor = m_reactor.get();
+    }
+    return first;
+}
+
+template <class F>
+std::size_t BoardFleet::for_each_board(F f) noexcept {
+    std::size_t count = 0;
+    for (auto& board : m_boards)
+        count += f(*board);
+    return count;
+}
+
+std::size_t BoardFleet::attach_sketch(const Sketch& sketch) noexcept {
+    return for_each_board([&](Board& board) { return board.attach_sketch(sketch); });
+}
+
+std::size_t BoardFleet::configure(const BoardConfig& bconf) noexcept {
+    return for_each_board([&](Board& board) { return board.configure(bconf); });
+}
+
+std::size_t BoardFleet::start() noexcept {
+    return for_each_board([](Board& board) { return board.start(); });
+}
+
+std::size_t BoardFleet::suspend() noexcept {
+    return for_each_board([](Board& board) { return board.suspend(); });
+}
+
+std::size_t BoardFleet::resume() noexcept {
+    return for_each_board([](Board& board) { return board.resume(); });
+}
+
+std::size_t BoardFleet::stop() noexcept {
+    return for_each_board([](Board& board) { return board.stop(); });
+}
+
+std::size_t BoardFleet::reset() noexcept {
+    return for_each_board([](Board& board) { return board.reset(); });
+}
+
+void BoardFleet::tick() noexcept {
+    for (auto& board : m_boards)
+        board->tick();
+}
+
+BoardFleet::Stats BoardFleet::stats() noexcept {
+    Stats ret;
+    ret.boards = m_boards.size();
+    ret.exits = m_exits;
+    for (auto& board : m_boards) {
+        switch (board->status()) {
+        case Board::Status::running:
+            ++ret.running;
+            break;
+        case Board::Status::suspended:
+            ++ret.suspended;
+            break;
+        case Board::Status::stopped:
+            ++ret.stopped;
+            break;
+        default:;
+        }
+        ret.log_bytes += board->runtime_log().end();
+    }
+    return ret;
+}
+
+} // namespace smce
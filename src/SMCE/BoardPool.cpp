@@ -0,0 +1,120 @@
+/*
+ *  BoardPool.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <SMCE/BoardPool.hpp>
+
+#include <algorithm>
+#include <SMCE/Sketch.hpp>
+#include <SMCE/internal/BoardInternal.hpp>
+
+namespace smce {
+
+BoardPool::BoardPool(const Sketch& sketch, BoardConfig bconf, std::size_t capacity, ForkServer* fork_server) noexcept
+    : m_sketch{sketch}, m_bconf{std::move(bconf)}, m_capacity{capacity}, m_fork_server{fork_server} {
+    m_ready.reserve(m_capacity);
+    m_filler = std::thread{[&] { fill(); }};
+}
+
+BoardPool::~BoardPool() {
+    {
+        [[maybe_unused]] std::lock_guard lk{m_mtx};
+        m_quit = true;
+    }
+    m_cv.notify_all();
+    if (m_filler.joinable())
+        m_filler.join();
+    m_ready.clear(); // reaps the parked sketches
+}
+
+std::size_t BoardPool::available() noexcept {
+    [[maybe_unused]] std::lock_guard lk{m_mtx};
+    return m_ready.size();
+}
+
+auto BoardPool::metrics() noexcept -> Metrics {
+    [[maybe_unused]] std::lock_guard lk{m_mtx};
+    return m_metrics;
+}
+
+bool BoardPool::warm_up() noexcept {
+    std::unique_lock lk{m_mtx};
+    m_cv.wait(lk, [&] { return m_failing || m_quit || m_ready.size() >= m_capacity; });
+    return !m_failing && m_ready.size() >= m_capacity;
+}
+
+/**
+ * Hands a pre-spawned sketch over to a board
+ * \return whether the board got one
+ **/
+bool BoardPool::take(Board& board) noexcept {
+    if (board.m_sketch_ptr != &m_sketch || !board.m_conf_opt || *board.m_conf_opt != m_bconf)
+        return false;
+
+    std::unique_ptr<Board::Internal> internal;
+    {
+        [[maybe_unused]] std::lock_guard lk{m_mtx};
+        m_failing = false; // give the filler another chance
+        while (!m_ready.empty()) {
+            auto candidate = std::move(m_ready.back());
+            m_ready.pop_back();
+            if (candidate->sketch.running()) { // discard the ones which died while parked
+                internal = std::move(candidate);
+                break;
+            }
+        }
+    }
+    m_cv.notify_all();
+
+    if (!internal)
+        return false;
+    board.m_internal = std::move(internal);
+    return true;
+}
+
+void BoardPool::record_start(bool hit, std::chrono::nanoseconds latency) noexcept {
+    [[maybe_unused]] std::lock_guard lk{m_mtx};
+    ++(hit ? m_metrics.hits : m_metrics.misses);
+    m_metrics.last_start_latency = latency;
+    m_metrics.max_start_latency = std::max(m_metrics.max_start_latency, latency);
+    m_metrics.total_start_latency += latency;
+}
+
+/**
+ * Keeps the pool topped up; runs on the filler thread
+ **/
+void BoardPool::fill() noexcept {
+    std::unique_lock lk{m_mtx};
+    for (;;) {
+        m_cv.wait(lk, [&] { return m_quit || (!m_failing && m_ready.size() < m_capacity); });
+        if (m_quit)
+            return;
+
+        lk.unlock();
+        auto internal = std::make_unique<Board::Internal>();
+        const bool spawned = m_sketch.is_compiled() && Board::do_prespawn(*internal, m_sketch, m_bconf, m_fork_server);
+        lk.lock();
+
+        if (spawned)
+            m_ready.push_back(std::move(internal));
+        else
+            m_failing = true;
+        m_cv.notify_all();
+    }
+}
+
+} // namespace smce
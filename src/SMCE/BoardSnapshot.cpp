@@ -0,0 +1,164 @@
+/*
+ *  BoardSnapshot.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "SMCE/BoardSnapshot.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+#include "SMCE/BoardView.hpp"
+#include "SMCE/internal/BoardData.hpp"
+
+namespace smce {
+namespace {
+
+/*
+ * Layout:
+ *   u16 pin count, u16 UART channel count, u16 frame-buffer count
+ *   per pin:          u16 id, u16 value, u8 direction, u8 active driver
+ *   per UART channel: u8 active, u16 rx size, u16 tx size, rx bytes, tx bytes (each padded to their max size)
+ *   per frame-buffer: u64 key, u16 width, u16 height, u8 freq, u8 transform
+ */
+
+// Runs of changed bytes closer than this are merged, as a run header would cost more than the bytes in-between
+constexpr std::size_t merge_gap = 2 * sizeof(std::uint32_t);
+
+template <class T>
+void put(std::vector<std::byte>& out, T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto pos = out.size();
+    out.resize(pos + sizeof(T));
+    std::memcpy(out.data() + pos, &value, sizeof(T));
+}
+
+template <class T>
+bool get(std::span<const std::byte>& in, T& value) noexcept {
+    if (in.size() < sizeof(T))
+        return false;
+    std::memcpy(&value, in.data(), sizeof(T));
+    in = in.subspan(sizeof(T));
+    return true;
+}
+
+void put_ring(std::vector<std::byte>& out, const BoardData::ByteRing& ring) {
+    const auto size_pos = out.size();
+    put(out, std::uint16_t{0});
+    const auto pos = out.size();
+    out.resize(pos + ring.capacity);
+    const auto size = static_cast<std::uint16_t>(ring.peek({reinterpret_cast<char*>(out.data() + pos), ring.capacity}));
+    std::memcpy(out.data() + size_pos, &size, sizeof(size));
+}
+
+} // namespace
+
+BoardSnapshot BoardSnapshot::capture(BoardView view) {
+    BoardSnapshot ret;
+    if (!view.valid())
+        return ret;
+    auto& bdat = *view.m_bdat;
+    auto& out = ret.m_bytes;
+
+    std::size_t size = 3 * sizeof(std::uint16_t) + bdat.pins.size() * 6 + bdat.frame_buffers.size() * 14;
+    for (const auto& chan : bdat.uart_channels)
+        size += 5 + chan.rx.capacity + chan.tx.capacity;
+    out.reserve(size);
+
+    put(out, static_cast<std::uint16_t>(bdat.pins.size()));
+    put(out, static_cast<std::uint16_t>(bdat.uart_channels.size()));
+    put(out, static_cast<std::uint16_t>(bdat.frame_buffers.size()));
+
+    for (std::size_t i = 0; i < bdat.pins.size(); ++i) {
+        const auto& pin = bdat.pins[i];
+        put(out, pin.id);
+        put(out, bdat.pin_value(i).load());
+        put(out, static_cast<std::uint8_t>(pin.data_direction.load()));
+        put(out, static_cast<std::uint8_t>(pin.active_driver.load()));
+    }
+    for (auto& chan : bdat.uart_channels) {
+        put(out, static_cast<std::uint8_t>(chan.active.load()));
+        put_ring(out, chan.rx);
+        put_ring(out, chan.tx);
+    }
+    for (const auto& fb : bdat.frame_buffers) {
+        put(out, static_cast<std::uint64_t>(fb.key));
+        put(out, fb.width.load());
+        put(out, fb.height.load());
+        put(out, fb.freq.load());
+        put(out, std::bit_cast<std::uint8_t>(fb.transform.load()));
+    }
+    return ret;
+}
+
+BoardSnapshot::Diff BoardSnapshot::diff_from(const BoardSnapshot& from) const {
+    Diff ret;
+    auto& out = ret.bytes;
+    put(out, static_cast<std::uint32_t>(m_bytes.size()));
+
+    const auto put_run = [&](std::size_t begin, std::size_t end) {
+        put(out, static_cast<std::uint32_t>(begin));
+        put(out, static_cast<std::uint32_t>(end - begin));
+        out.insert(out.end(), m_bytes.begin() + begin, m_bytes.begin() + end);
+    };
+
+    const auto common = std::min(m_bytes.size(), from.m_bytes.size());
+    std::size_t i = 0;
+    while (i < common) {
+        if (m_bytes[i] == from.m_bytes[i]) {
+            ++i;
+            continue;
+        }
+        const auto begin = i;
+        auto end = ++i;
+        for (; i < common && i - end < merge_gap; ++i) {
+            if (m_bytes[i] != from.m_bytes[i])
+                end = i + 1;
+        }
+        put_run(begin, end);
+    }
+    if (m_bytes.size() > common)
+        put_run(common, m_bytes.size());
+    return ret;
+}
+
+bool BoardSnapshot::apply(const Diff& diff) {
+    std::span<const std::byte> in = diff.bytes;
+    std::uint32_t size;
+    if (!get(in, size))
+        return false;
+
+    // Validate the whole delta first, as to never leave a half-patched snapshot behind
+    for (auto runs = in; !runs.empty();) {
+        std::uint32_t offset, length;
+        if (!get(runs, offset) || !get(runs, length) || std::uint64_t{offset} + length > size || runs.size() < length)
+            return false;
+        runs = runs.subspan(length);
+    }
+
+    m_bytes.resize(size);
+    while (!in.empty()) {
+        std::uint32_t offset, length;
+        get(in, offset);
+        get(in, length);
+        std::copy_n(in.begin(), length, m_bytes.begin() + offset);
+        in = in.subspan(length);
+    }
+    return true;
+}
+
+} // namespace smce
@@ -18,18 +18,106 @@
 
 #include "SMCE/BoardView.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iterator>
 #include <mutex>
-#include <boost/date_time/microsec_time_clock.hpp>
-#include <boost/date_time/posix_time/posix_time_duration.hpp>
-#include <boost/date_time/posix_time/ptime.hpp>
+#include <thread>
 #include "SMCE/internal/BoardData.hpp"
-#include "SMCE/internal/utils.hpp"
-
-using microsec_clock = boost::date_time::microsec_clock<boost::posix_time::ptime>;
 
 namespace smce {
 
+namespace {
+
+std::int64_t wall_time(std::chrono::steady_clock::time_point tp = std::chrono::steady_clock::now()) noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+}
+
+struct ClockState {
+    std::uint32_t seq;
+    std::int64_t wall_origin;
+    std::int64_t board_origin;
+    double speed_factor;
+
+    [[nodiscard]] std::int64_t board_time(std::int64_t wall) const noexcept {
+        return board_origin + static_cast<std::int64_t>(static_cast<double>(wall - wall_origin) * speed_factor);
+    }
+};
+
+/// Consistent read of the clock (seqlock reader)
+ClockState read_clock(BoardData::Clock& clock) noexcept {
+    for (;;) {
+        const auto seq = clock.seq.load();
+        if (seq & 1)
+            continue;
+        const ClockState ret{seq, clock.wall_origin.load(), clock.board_origin.load(), clock.speed_factor.load()};
+        if (clock.seq.load() == seq)
+            return ret;
+    }
+}
+
+/// Exclusive update of the clock (seqlock writer); wakes up its waiters
+template <class F>
+void update_clock(BoardData::Clock& clock, F f) noexcept {
+    auto seq = clock.seq.load();
+    do
+        seq &= ~std::uint32_t{1};
+    while (!clock.seq.compare_exchange_weak(seq, seq + 1));
+    f();
+    clock.seq = seq + 2;
+    clock.seq.notify_all();
+}
+
+/// Ring of a UART channel in either direction; rx rings are written by the host, tx ones by the sketch
+BoardData::ByteRing& uart_ring(BoardData& bdat, std::size_t idx, bool rx) noexcept {
+    auto& chan = bdat.uart_channels[idx];
+    return rx ? chan.rx : chan.tx;
+}
+
+/// Board time (ns) by which the last byte queued in a UART ring gets through its line
+IpcAtomicValue<std::int64_t>& uart_line(BoardData& bdat, std::size_t idx, bool rx) noexcept {
+    auto& chan = bdat.uart_channels[idx];
+    return rx ? chan.rx_line_busy_until : chan.tx_line_busy_until;
+}
+
+/// Board time (ns) a byte takes to go through a UART line: a start bit, 8 data bits and a stop bit
+std::int64_t byte_duration(const BoardData::UartChannel& chan) noexcept {
+    return std::int64_t{10'000'000'000} / std::max<std::uint32_t>(chan.baud_rate, 1);
+}
+
+/// Number of the bytes queued in a UART ring which have yet to get through its line; 0 unless paced
+std::size_t bytes_in_flight(BoardData& bdat, std::size_t idx, bool rx, std::size_t queued) noexcept {
+    const auto& chan = bdat.uart_channels[idx];
+    if (queued == 0 || !chan.paced.load())
+        return 0;
+    const auto left = uart_line(bdat, idx, rx).load() - read_clock(bdat.clock).board_time(wall_time());
+    if (left <= 0)
+        return 0;
+    const auto duration = byte_duration(chan);
+    return std::min(queued, static_cast<std::size_t>((left + duration - 1) / duration));
+}
+
+/// Puts bytes just queued in a UART ring on its line, behind those already going through
+void send_on_line(BoardData& bdat, std::size_t idx, bool rx, std::size_t count) noexcept {
+    const auto& chan = bdat.uart_channels[idx];
+    if (count == 0 || !chan.paced.load())
+        return;
+    auto& line = uart_line(bdat, idx, rx);
+    const auto start = std::max(line.load(), read_clock(bdat.clock).board_time(wall_time()));
+    line.store(start + static_cast<std::int64_t>(count) * byte_duration(chan));
+}
+
+/// Resizes the pixel data of a frame-buffer (RGB888) for new dimensions, growing it within the segment if need be
+bool resize_frame(BoardData::FrameBuffer& fb, std::size_t width, std::size_t height) noexcept try {
+    [[maybe_unused]] std::lock_guard lk{fb.data_mut};
+    fb.data.resize(width * height * 3);
+    return true;
+} catch (const std::exception&) {
+    return false; // out of room in the segment
+}
+
+} // namespace
+
 [[nodiscard]] std::string_view BoardView::storage_get_root(Link link, std::uint16_t accessor) noexcept {
     if (!m_bdat)
         return {};
@@ -60,12 +148,12 @@ namespace smce {
 }
 
 [[nodiscard]] std::uint16_t VirtualAnalogDriver::read() noexcept {
-    return exists() ? m_bdat->pins[m_idx].value.load() : 0;
+    return exists() ? m_bdat->pin_value(m_idx).load() : 0;
 }
 
 void VirtualAnalogDriver::write(std::uint16_t value) noexcept {
     if (exists())
-        m_bdat->pins[m_idx].value.store(value);
+        m_bdat->pin_value(m_idx).store(value);
 }
 
 [[nodiscard]] bool VirtualDigitalDriver::exists() noexcept { return m_bdat && m_idx < m_bdat->pins.size(); }
@@ -78,11 +166,11 @@ void VirtualAnalogDriver::write(std::uint16_t value) noexcept {
     return exists() && m_bdat->pins[m_idx].can_digital_write;
 }
 
-[[nodiscard]] bool VirtualDigitalDriver::read() noexcept { return exists() && m_bdat->pins[m_idx].value.load(); }
+[[nodiscard]] bool VirtualDigitalDriver::read() noexcept { return exists() && m_bdat->pin_value(m_idx).load(); }
 
 void VirtualDigitalDriver::write(bool value) noexcept {
     if (exists())
-        m_bdat->pins[m_idx].value.store(value ? 255 : 0);
+        m_bdat->pin_value(m_idx).store(value ? 255 : 0);
 }
 
 [[nodiscard]] bool VirtualPin::exists() noexcept { return m_bdat && m_idx < m_bdat->pins.size(); }
@@ -104,111 +192,173 @@ void VirtualPin::set_direction(DataDirection dir) noexcept {
 VirtualPin VirtualPins::operator[](std::size_t pin_id) noexcept {
     if (!m_bdat)
         return {m_bdat, 0};
-    const auto it = std::lower_bound(m_bdat->pins.begin(), m_bdat->pins.end(), pin_id,
-                                     [](const auto& pin, std::size_t pin_id) { return pin.id < pin_id; });
-    if (it != m_bdat->pins.end()) {
-        if (const auto delta = std::distance(m_bdat->pins.begin(), it); delta >= 0 && m_bdat->pins[delta].id == pin_id)
-            return {m_bdat, static_cast<std::size_t>(delta)};
-    }
+    if (const auto idx = m_bdat->pin_index(pin_id); idx != BoardData::no_pin)
+        return {m_bdat, idx};
     return {nullptr, std::size_t(-1)};
 }
 
+[[nodiscard]] std::size_t VirtualPins::size() noexcept { return m_bdat ? m_bdat->pins.size() : 0; }
+
+std::size_t VirtualPins::read(std::span<PinState> buf) noexcept {
+    if (!m_bdat)
+        return 0;
+    const auto count = std::min(buf.size(), m_bdat->pins.size());
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& pin = m_bdat->pins[i];
+        const bool locked = pin.active_driver.load() != BoardData::Pin::ActiveDriver::gpio;
+        buf[i] = {pin.id, m_bdat->pin_value(i).load(),
+                  locked ? VirtualPin::DataDirection::in
+                         : static_cast<VirtualPin::DataDirection>(pin.data_direction.load())};
+    }
+    return count;
+}
+
+std::size_t VirtualPins::write(std::span<const PinWrite> writes) noexcept {
+    if (!m_bdat)
+        return 0;
+    std::size_t count = 0;
+    for (const auto& write : writes) {
+        if (const auto idx = m_bdat->pin_index(write.id); idx != BoardData::no_pin) {
+            m_bdat->pin_value(idx).store(write.value);
+            ++count;
+        }
+    }
+    return count;
+}
+
+[[nodiscard]] bool VirtualPinEvents::exists() noexcept { return m_bdat && m_bdat->pin_events.capacity != 0; }
+
+[[nodiscard]] std::size_t VirtualPinEvents::size() noexcept { return exists() ? m_bdat->pin_events.size() : 0; }
+
+[[nodiscard]] std::uint64_t VirtualPinEvents::dropped() noexcept {
+    return exists() ? m_bdat->pin_events_dropped.load() : 0;
+}
+
+std::size_t VirtualPinEvents::read(std::span<PinEvent> buf) noexcept {
+    if (!exists())
+        return 0;
+    std::size_t count = 0;
+    std::array<BoardData::PinEvent, 64> chunk;
+    while (count < buf.size()) {
+        const auto chunk_count =
+            m_bdat->pin_events.read(std::span{chunk}.first(std::min(chunk.size(), buf.size() - count)));
+        if (chunk_count == 0)
+            break;
+        for (const auto& ev : std::span{chunk}.first(chunk_count))
+            buf[count++] = {std::chrono::nanoseconds{ev.time}, ev.pin, ev.value};
+    }
+    return count;
+}
+
+bool VirtualPinEvents::wait(std::chrono::nanoseconds timeout) noexcept {
+    return exists() && m_bdat->pin_events.wait_readable(timeout);
+}
+
+void VirtualPinEvents::push(std::uint16_t pin_id, std::uint16_t value) noexcept {
+    if (!exists())
+        return;
+    const BoardData::PinEvent ev{read_clock(m_bdat->clock).board_time(wall_time()), pin_id, value};
+    if (m_bdat->pin_events.write({&ev, 1}) == 0)
+        m_bdat->pin_events_dropped.fetch_add(1);
+}
+
 [[nodiscard]] bool VirtualUartBuffer::exists() noexcept { return m_bdat && m_index < m_bdat->uart_channels.size(); }
 
 [[nodiscard]] std::size_t VirtualUartBuffer::max_size() noexcept {
-    // clang-format off
-    return exists() ? (m_dir == Direction::rx
-                           ? m_bdat->uart_channels[m_index].max_buffered_rx
-                           : m_bdat->uart_channels[m_index].max_buffered_tx) : 0;
-    // clang-format on
+    return exists() ? uart_ring(*m_bdat, m_index, m_dir == Direction::rx).capacity : 0;
 }
 
 [[nodiscard]] std::size_t VirtualUartBuffer::size() noexcept {
     if (!exists())
         return 0;
-    auto& chan = m_bdat->uart_channels[m_index];
-    auto [d, mut] = [&] {
-        switch (m_dir) {
-        case Direction::rx:
-            return std::tie(chan.rx, chan.rx_mut);
-        case Direction::tx:
-            return std::tie(chan.tx, chan.tx_mut);
-        }
-        unreachable();
-    }();
-    if (!mut.timed_lock(microsec_clock::universal_time() + boost::posix_time::seconds{1}))
-        return 0;
-    const auto ret = d.size();
-    mut.unlock();
-    return ret;
+    const bool rx = m_dir == Direction::rx;
+    const auto queued = uart_ring(*m_bdat, m_index, rx).size();
+    return queued - bytes_in_flight(*m_bdat, m_index, rx, queued);
 }
 
 std::size_t VirtualUartBuffer::read(std::span<char> buf) noexcept {
     if (!exists())
         return 0;
-    auto& chan = m_bdat->uart_channels[m_index];
-    auto [d, mut, max_buffered] = [&] {
-        switch (m_dir) {
-        case Direction::rx:
-            return std::tie(chan.rx, chan.rx_mut, chan.max_buffered_rx);
-        case Direction::tx:
-            return std::tie(chan.tx, chan.tx_mut, chan.max_buffered_tx);
-        }
-        unreachable();
-    }();
-    if (!mut.timed_lock(microsec_clock::universal_time() + boost::posix_time::seconds{1}))
-        return 0;
-    const std::size_t count = std::min(d.size(), buf.size());
-    std::copy_n(d.begin(), count, buf.begin());
-    d.erase(d.begin(), d.begin() + count);
-    mut.unlock();
-    return count;
+    return uart_ring(*m_bdat, m_index, m_dir == Direction::rx).read(buf.first(std::min(buf.size(), size())));
 }
 
 std::size_t VirtualUartBuffer::write(std::span<const char> buf) noexcept {
     if (!exists())
         return 0;
-    auto& chan = m_bdat->uart_channels[m_index];
-    auto [d, mut, max_buffered] = [&] {
-        switch (m_dir) {
-        case Direction::rx:
-            return std::tie(chan.rx, chan.rx_mut, chan.max_buffered_rx);
-        case Direction::tx:
-            return std::tie(chan.tx, chan.tx_mut, chan.max_buffered_tx);
-        }
-        unreachable();
-    }();
-    if (!mut.timed_lock(microsec_clock::universal_time() + boost::posix_time::seconds{1}))
-        return 0;
-    const std::size_t count = std::min(
-        std::clamp(max_buffered - d.size(), std::size_t{0}, static_cast<std::size_t>(max_buffered)), buf.size());
-    std::copy_n(buf.begin(), count, std::back_inserter(d));
-    mut.unlock();
+    const bool rx = m_dir == Direction::rx;
+    const auto count = uart_ring(*m_bdat, m_index, rx).write(buf);
+    send_on_line(*m_bdat, m_index, rx, count);
     return count;
 }
 
 [[nodiscard]] char VirtualUartBuffer::front() noexcept {
-    if (!exists())
-        return '\0';
-    auto& chan = m_bdat->uart_channels[m_index];
-    auto [d, mut] = [&] {
-        switch (m_dir) {
-        case Direction::rx:
-            return std::tie(chan.rx, chan.rx_mut);
-        case Direction::tx:
-            return std::tie(chan.tx, chan.tx_mut);
-        }
-        unreachable();
-    }();
-    if (!mut.timed_lock(microsec_clock::universal_time() + boost::posix_time::seconds{1}))
-        return 0;
-    if (d.empty())
-        return '\0';
-    const char ret = d.front();
-    mut.unlock();
+    char ret = '\0';
+    if (size() != 0)
+        uart_ring(*m_bdat, m_index, m_dir == Direction::rx).peek({&ret, 1});
     return ret;
 }
 
+[[nodiscard]] auto VirtualUartBuffer::acquire_read() noexcept -> Spans<const char> {
+    if (!exists())
+        return {};
+    const auto count = size();
+    const auto spans = uart_ring(*m_bdat, m_index, m_dir == Direction::rx).readable();
+    const auto first = spans[0].first(std::min(count, spans[0].size()));
+    return {first, spans[1].first(count - first.size())};
+}
+
+void VirtualUartBuffer::commit_read(std::size_t count) noexcept {
+    // Clamped as `read` is, so that bytes still on the line (never handed out) cannot be dequeued
+    if (exists())
+        uart_ring(*m_bdat, m_index, m_dir == Direction::rx).consume(std::min(count, size()));
+}
+
+[[nodiscard]] auto VirtualUartBuffer::acquire_write() noexcept -> Spans<char> {
+    if (!exists())
+        return {};
+    const auto spans = uart_ring(*m_bdat, m_index, m_dir == Direction::rx).writable();
+    return {spans[0], spans[1]};
+}
+
+void VirtualUartBuffer::commit_write(std::size_t count) noexcept {
+    if (!exists())
+        return;
+    const bool rx = m_dir == Direction::rx;
+    send_on_line(*m_bdat, m_index, rx, uart_ring(*m_bdat, m_index, rx).commit(count));
+}
+
+bool VirtualUartBuffer::wait_readable(std::chrono::nanoseconds timeout) noexcept {
+    if (!exists())
+        return false;
+    const bool rx = m_dir == Direction::rx;
+    auto& ring = uart_ring(*m_bdat, m_index, rx);
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        const auto remaining = timeout - (std::chrono::steady_clock::now() - start);
+        if (!ring.wait_readable(std::max(remaining, std::chrono::nanoseconds::zero())))
+            return false;
+        const auto queued = ring.size();
+        if (bytes_in_flight(*m_bdat, m_index, rx, queued) < queued)
+            return true;
+        if (remaining <= std::chrono::nanoseconds::zero())
+            return false;
+        // Everything queued is still going through the line; sleeps until the first byte is in
+        const auto& chan = m_bdat->uart_channels[m_index];
+        const auto first_in = uart_line(*m_bdat, m_index, rx).load() -
+                              static_cast<std::int64_t>(queued - 1) * byte_duration(chan);
+        const auto clock = read_clock(m_bdat->clock);
+        auto sleep = std::chrono::nanoseconds{std::chrono::milliseconds{1}}; // stepped; polls for host steps
+        if (clock.speed_factor > 0)
+            sleep = std::chrono::nanoseconds{static_cast<std::int64_t>(
+                std::ceil(static_cast<double>(first_in - clock.board_time(wall_time())) / clock.speed_factor))};
+        std::this_thread::sleep_for(std::clamp(sleep, std::chrono::nanoseconds{1}, remaining));
+    }
+}
+
+bool VirtualUartBuffer::wait_writable(std::chrono::nanoseconds timeout) noexcept {
+    return exists() && uart_ring(*m_bdat, m_index, m_dir == Direction::rx).wait_writable(timeout);
+}
+
 [[nodiscard]] bool VirtualUart::exists() noexcept { return m_bdat && m_index < m_bdat->uart_channels.size(); }
 
 [[nodiscard]] bool VirtualUart::is_active() noexcept {
@@ -220,6 +370,17 @@ void VirtualUart::set_active(bool value) noexcept {
         m_bdat->uart_channels[m_index].active.store(value);
 }
 
+[[nodiscard]] bool VirtualUart::is_paced() noexcept { return exists() && m_bdat->uart_channels[m_index].paced.load(); }
+
+void VirtualUart::set_paced(bool value) noexcept {
+    if (exists())
+        m_bdat->uart_channels[m_index].paced.store(value);
+}
+
+[[nodiscard]] std::size_t VirtualUart::flushing_threshold() noexcept {
+    return exists() ? m_bdat->uart_channels[m_index].flushing_threshold : 0;
+}
+
 [[nodiscard]] VirtualUart VirtualUarts::operator[](std::size_t idx) noexcept {
     if (!m_bdat || m_bdat->uart_channels.size() <= idx)
         return VirtualUart{m_bdat, idx};
@@ -274,8 +435,8 @@ void FrameBuffer::set_width(std::uint16_t width) noexcept {
     if (!exists())
         return;
     auto& fb = m_bdat->frame_buffers[m_idx];
-    fb.width = width;
-    fb.data.resize(width * fb.height * 3);
+    if (resize_frame(fb, width, fb.height))
+        fb.width = width;
 }
 
 [[nodiscard]] std::uint16_t FrameBuffer::get_height() noexcept {
@@ -286,8 +447,8 @@ void FrameBuffer::set_height(std::uint16_t height) noexcept {
     if (!exists())
         return;
     auto& fb = m_bdat->frame_buffers[m_idx];
-    fb.height = height;
-    fb.data.resize(height * fb.width * 3);
+    if (resize_frame(fb, fb.width, height))
+        fb.height = height;
 }
 
 [[nodiscard]] std::uint8_t FrameBuffer::get_freq() noexcept {
@@ -300,6 +461,10 @@ void FrameBuffer::set_freq(std::uint8_t freq) noexcept {
     m_bdat->frame_buffers[m_idx].freq = freq;
 }
 
+[[nodiscard]] std::uint32_t FrameBuffer::frame_count() noexcept {
+    return exists() ? m_bdat->frame_buffers[m_idx].frames.load() : 0;
+}
+
 bool FrameBuffer::write_rgb888(std::span<const std::byte> buf) {
     if (!exists())
         return false;
@@ -310,6 +475,7 @@ bool FrameBuffer::write_rgb888(std::span<const std::byte> buf) {
 
     [[maybe_unused]] std::lock_guard lk{frame_buf.data_mut};
     std::memcpy(frame_buf.data.data(), buf.data(), buf.size());
+    frame_buf.frames.fetch_add(1);
     return true;
 }
 
@@ -340,6 +506,7 @@ bool FrameBuffer::write_rgb444(std::span<const std::byte> buf) {
         *to++ = from & std::byte{0xF};
         *to++ = from << 4; // Might be a bug there in the case where we have an odd number of pixels in the frame
     }
+    frame_buf.frames.fetch_add(1);
 
     return true;
 }
@@ -362,6 +529,75 @@ bool FrameBuffer::read_rgb444(std::span<std::byte> buf) {
     return true;
 }
 
+[[nodiscard]] bool VirtualClock::exists() noexcept { return m_bdat; }
+
+[[nodiscard]] std::chrono::nanoseconds VirtualClock::now() noexcept {
+    if (!exists())
+        return {};
+    return std::chrono::nanoseconds{read_clock(m_bdat->clock).board_time(wall_time())};
+}
+
+[[nodiscard]] double VirtualClock::speed_factor() noexcept {
+    if (!exists())
+        return 0;
+    return m_bdat->clock.speed_factor;
+}
+
+void VirtualClock::set_speed_factor(double factor) noexcept {
+    if (!exists() || !(factor >= 0))
+        return;
+    auto& clock = m_bdat->clock;
+    update_clock(clock, [&] {
+        const auto wall = wall_time();
+        clock.board_origin = ClockState{0, clock.wall_origin, clock.board_origin, clock.speed_factor}.board_time(wall);
+        clock.wall_origin = wall;
+        clock.speed_factor = factor;
+    });
+}
+
+void VirtualClock::advance(std::chrono::nanoseconds delta) noexcept {
+    if (!exists())
+        return;
+    auto& clock = m_bdat->clock;
+    update_clock(clock, [&] { clock.board_origin.fetch_add(delta.count()); });
+}
+
+void VirtualClock::reset() noexcept {
+    if (!exists())
+        return;
+    auto& clock = m_bdat->clock;
+    update_clock(clock, [&] {
+        clock.wall_origin = wall_time();
+        clock.board_origin = 0;
+    });
+}
+
+bool VirtualClock::wait_until(std::chrono::nanoseconds deadline, std::chrono::nanoseconds max_wait) noexcept {
+    if (!exists())
+        return false;
+    auto& clock = m_bdat->clock;
+    const auto wait_start = std::chrono::steady_clock::now();
+    for (;;) {
+        const auto state = read_clock(clock);
+        const auto wall = std::chrono::steady_clock::now();
+        const auto remaining = deadline.count() - state.board_time(wall_time(wall));
+        if (remaining <= 0)
+            return true;
+        const auto waited = wall - wait_start;
+        if (waited >= max_wait)
+            return false;
+        if (state.speed_factor > 0) {
+            // Sleeps by at most a second so that speed changes get picked up
+            const auto max_sleep = std::min<std::chrono::nanoseconds>(max_wait - waited, std::chrono::seconds{1});
+            const auto sleep = std::min(std::ceil(static_cast<double>(remaining) / state.speed_factor),
+                                        static_cast<double>(max_sleep.count()));
+            std::this_thread::sleep_for(std::chrono::nanoseconds{static_cast<std::int64_t>(sleep)});
+        } else {
+            clock.seq.wait(state.seq);
+        }
+    }
+}
+
 FrameBuffer FrameBuffers::operator[](std::size_t key) noexcept {
     if (!m_bdat)
         return {m_bdat, 0};
@@ -0,0 +1,162 @@
+/*
+ *  ForkServer.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <SMCE/ForkServer.hpp>
+#include <boost/predef.h>
+
+#if BOOST_OS_LINUX
+extern "C" {
+#    include <sys/prctl.h>
+#    include <sys/socket.h>
+#    include <unistd.h>
+}
+#    include <array>
+#    include <cstring>
+#endif
+
+#include <mutex>
+#include <string>
+#include <SMCE/Sketch.hpp>
+#include <boost/process.hpp>
+#include <boost/process/extend.hpp>
+
+namespace bp = boost::process;
+
+namespace smce {
+
+#if BOOST_OS_LINUX
+namespace {
+
+/**
+ * Makes the host a child subreaper for as long as any instance lives, so that it adopts the sketches the zygote
+ * orphans; left as is if it already was one
+ * \note Process-wide, hence only held while handing sketches over, as every orphaned descendant gets adopted meanwhile
+ **/
+class SubreaperScope {
+    static inline std::mutex mtx;
+    static inline int holders = 0;
+    static inline bool preset = false; // whether the host was a subreaper of its own
+
+  public:
+    SubreaperScope() noexcept {
+        [[maybe_unused]] std::lock_guard lk{mtx};
+        if (holders++ != 0)
+            return;
+        int current = 0;
+        ::prctl(PR_GET_CHILD_SUBREAPER, &current);
+        preset = current != 0;
+        if (!preset)
+            ::prctl(PR_SET_CHILD_SUBREAPER, 1);
+    }
+    ~SubreaperScope() {
+        [[maybe_unused]] std::lock_guard lk{mtx};
+        if (--holders == 0 && !preset)
+            ::prctl(PR_SET_CHILD_SUBREAPER, 0);
+    }
+    SubreaperScope(const SubreaperScope&) = delete;
+    SubreaperScope& operator=(const SubreaperScope&) = delete;
+};
+
+} // namespace
+#endif
+
+struct ForkServer::Internal {
+    bp::child zygote;
+    int ctl_fd = -1; // our end of the control socket; the zygote has the other one as its stdin
+};
+
+ForkServer::ForkServer(const Sketch& sketch) noexcept : m_sketch{sketch}, m_internal{std::make_unique<Internal>()} {
+#if BOOST_OS_LINUX
+    if (!m_sketch.is_compiled())
+        return;
+
+    std::array<int, 2> fds;
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds.data()) != 0)
+        return;
+
+    try {
+        const int zygote_end = fds[1];
+        // clang-format off
+        m_internal->zygote = bp::child{
+            bp::env["SMCE_ZYGOTE"] = "1",
+            bp::env["SMCE_PARKED"] = "1",
+            "\"" + m_sketch.m_executable.string() + "\"",
+            bp::std_out > bp::null,
+            bp::extend::on_exec_setup = [=](auto&) { ::dup2(zygote_end, STDIN_FILENO); }
+        };
+        // clang-format on
+    } catch (const std::exception&) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return;
+    }
+    ::close(fds[1]);
+    m_internal->ctl_fd = fds[0];
+#endif
+}
+
+ForkServer::~ForkServer() {
+#if BOOST_OS_LINUX
+    if (m_internal->ctl_fd >= 0)
+        ::close(m_internal->ctl_fd); // the zygote exits on hang-up
+#endif
+    [[maybe_unused]] std::error_code ignored;
+    m_internal->zygote.wait(ignored);
+}
+
+bool ForkServer::valid() noexcept {
+    std::error_code ec;
+    return m_internal->ctl_fd >= 0 && m_internal->zygote.running(ec) && !ec;
+}
+
+int ForkServer::fork([[maybe_unused]] std::string_view segname, [[maybe_unused]] int stdin_fd,
+                     [[maybe_unused]] int stderr_fd, [[maybe_unused]] int seg_fd) noexcept {
+#if BOOST_OS_LINUX
+    [[maybe_unused]] std::lock_guard lk{m_mtx};
+    if (m_internal->ctl_fd < 0)
+        return -1;
+
+    const std::array<int, 3> fds{stdin_fd, stderr_fd, seg_fd};
+    const std::size_t fds_size = (seg_fd >= 0 ? 3 : 2) * sizeof(int); // the segment fd is only passed if any
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(fds))> ctl_buf{};
+    ::iovec iov{const_cast<char*>(segname.data()), segname.size()};
+    ::msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl_buf.data();
+    msg.msg_controllen = CMSG_SPACE(fds_size);
+    ::cmsghdr* const cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_size);
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), fds_size);
+    // The zygote only replies once the sketch got orphaned (onto us), after which it stays our child
+    const SubreaperScope subreaper;
+    if (::sendmsg(m_internal->ctl_fd, &msg, MSG_NOSIGNAL) < 0)
+        return -1;
+
+    int pid = -1;
+    if (::recv(m_internal->ctl_fd, &pid, sizeof(pid), 0) != sizeof(pid))
+        return -1;
+    return pid;
+#else
+    return -1;
+#endif
+}
+
+} // namespace smce
@@ -0,0 +1,146 @@
+/*
+ *  Reactor.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "SMCE/internal/Reactor.hpp"
+#include <boost/predef.h>
+
+#if BOOST_OS_LINUX
+extern "C" {
+#    include <sys/epoll.h>
+#    include <sys/eventfd.h>
+#    include <unistd.h>
+}
+#    include <array>
+#    include <cerrno>
+#    include <span>
+#endif
+
+namespace smce {
+
+Reactor::Reactor() noexcept {
+#if BOOST_OS_LINUX
+    m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    m_wake_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_epoll_fd < 0 || m_wake_fd < 0)
+        return;
+    ::epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0; // never a valid token
+    if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &ev) != 0)
+        return;
+    try {
+        m_loop = std::thread{[this] { run(); }};
+    } catch (const std::system_error&) {
+    }
+#endif
+}
+
+Reactor::~Reactor() {
+#if BOOST_OS_LINUX
+    if (m_loop.joinable()) {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] const auto written = ::write(m_wake_fd, &one, sizeof(one));
+        m_loop.join();
+    }
+    for (const int fd : {m_wake_fd, m_epoll_fd}) {
+        if (fd >= 0)
+            ::close(fd);
+    }
+#endif
+}
+
+Reactor& Reactor::shared() noexcept {
+    static auto* const reactor = new Reactor{}; // never destroyed, as boards may outlive static destruction
+    return *reactor;
+}
+
+Reactor::Token Reactor::add([[maybe_unused]] int fd, [[maybe_unused]] std::uint32_t events,
+                            [[maybe_unused]] Handler handler) noexcept try {
+#if BOOST_OS_LINUX
+    if (!valid())
+        return 0;
+    [[maybe_unused]] std::lock_guard lk{m_mtx};
+    const Token token = m_next_token++;
+    m_watches.emplace(token, Watch{fd, events | EPOLLONESHOT, std::make_shared<Handler>(std::move(handler))});
+    ::epoll_event ev{};
+    ev.events = events | EPOLLONESHOT;
+    ev.data.u64 = token;
+    if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        m_watches.erase(token);
+        return 0;
+    }
+    return token;
+#else
+    return 0;
+#endif
+} catch (const std::bad_alloc&) {
+    return 0;
+}
+
+void Reactor::remove([[maybe_unused]] Token token) noexcept {
+#if BOOST_OS_LINUX
+    std::unique_lock lk{m_mtx};
+    const auto it = m_watches.find(token);
+    if (it == m_watches.end())
+        return;
+    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    m_watches.erase(it);
+    if (std::this_thread::get_id() != m_loop.get_id())
+        m_dispatch_cv.wait(lk, [&] { return m_dispatching != token; });
+#endif
+}
+
+void Reactor::run() noexcept {
+#if BOOST_OS_LINUX
+    std::array<::epoll_event, 64> events;
+    for (;;) {
+        const int count = ::epoll_wait(m_epoll_fd, events.data(), events.size(), -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        for (const auto& ev : std::span{events.data(), static_cast<std::size_t>(count)}) {
+            const Token token = ev.data.u64;
+            if (token == 0)
+                return; // woken up to quit
+
+            std::unique_lock lk{m_mtx};
+            const auto it = m_watches.find(token);
+            if (it == m_watches.end())
+                continue; // removed since
+            const auto handler = it->second.handler;
+            m_dispatching = token;
+            lk.unlock();
+            const bool rearm = (*handler)(ev.events);
+            lk.lock();
+            m_dispatching = 0;
+            if (const auto watch = m_watches.find(token); rearm && watch != m_watches.end()) {
+                ::epoll_event rearmed{};
+                rearmed.events = watch->second.events;
+                rearmed.data.u64 = token;
+                ::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, watch->second.fd, &rearmed);
+            }
+            lk.unlock();
+            m_dispatch_cv.notify_all();
+        }
+    }
+#endif
+}
+
+} // namespace smce
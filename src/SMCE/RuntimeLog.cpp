@@ -0,0 +1,87 @@
+/*
+ *  RuntimeLog.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <SMCE/RuntimeLog.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace smce {
+
+RuntimeLog::RuntimeLog(std::size_t capacity)
+    : m_capacity{std::bit_ceil(std::max<std::size_t>(capacity, 1))}, m_ring{std::make_unique<char[]>(m_capacity)} {}
+
+std::uint64_t RuntimeLog::begin() const noexcept {
+    const auto end = m_end.load(std::memory_order_acquire);
+    return std::max(m_cleared.load(std::memory_order_relaxed), end > m_capacity ? end - m_capacity : 0);
+}
+
+RuntimeLog::Chunk RuntimeLog::read(std::uint64_t cursor) const noexcept {
+    const auto end = m_end.load(std::memory_order_acquire);
+    const auto claimed = m_claimed.load(std::memory_order_relaxed);
+    // Bytes which the writer may currently be overwriting are skipped as well
+    const auto oldest =
+        std::max(m_cleared.load(std::memory_order_relaxed), claimed > m_capacity ? claimed - m_capacity : 0);
+    const auto begin = std::min(std::max(cursor, oldest), end);
+
+    const auto offset = static_cast<std::size_t>(begin & (m_capacity - 1));
+    const auto size = static_cast<std::size_t>(end - begin);
+    const auto first_size = std::min(size, m_capacity - offset);
+    return {begin, end, {m_ring.get() + offset, first_size}, {m_ring.get(), size - first_size}};
+}
+
+bool RuntimeLog::intact(const Chunk& chunk) const noexcept {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_claimed.load(std::memory_order_relaxed) <= chunk.begin + m_capacity;
+}
+
+std::string RuntimeLog::copy(std::uint64_t cursor) const {
+    for (;;) {
+        const auto chunk = read(cursor);
+        std::string ret;
+        ret.reserve(chunk.size());
+        ret.append(chunk.first.data(), chunk.first.size());
+        ret.append(chunk.second.data(), chunk.second.size());
+        if (intact(chunk))
+            return ret;
+    }
+}
+
+void RuntimeLog::write(std::span<const char> bytes) noexcept {
+    if (bytes.empty())
+        return;
+    const auto end = m_end.load(std::memory_order_relaxed);
+    const auto new_end = end + bytes.size();
+    if (bytes.size() > m_capacity)
+        bytes = bytes.last(m_capacity);
+
+    m_claimed.store(new_end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const auto offset = static_cast<std::size_t>((new_end - bytes.size()) & (m_capacity - 1));
+    const auto first_size = std::min(bytes.size(), m_capacity - offset);
+    std::memcpy(m_ring.get() + offset, bytes.data(), first_size);
+    std::memcpy(m_ring.get(), bytes.data() + first_size, bytes.size() - first_size);
+
+    m_end.store(new_end, std::memory_order_release);
+}
+
+void RuntimeLog::clear() noexcept { m_cleared.store(m_end.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+} // namespace smce
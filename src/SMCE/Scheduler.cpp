@@ -0,0 +1,90 @@
+/*
+ *  Scheduler.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "SMCE/Scheduler.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace smce {
+
+Scheduler::Wait::Wait(Scheduler& sched, std::chrono::nanoseconds timeout, bool (*ready)(Wait&)) noexcept
+    : m_sched{sched}, m_check{ready} {
+    const auto now = Clock::now();
+    // Saturates, so that huge timeouts (i.e. nanoseconds::max()) mean waiting forever
+    m_deadline = (timeout >= Clock::time_point::max() - now) ? Clock::time_point::max()
+                                                             : now + std::chrono::ceil<Clock::duration>(timeout);
+}
+
+void Scheduler::Wait::await_suspend(std::coroutine_handle<> awaiting) {
+    m_awaiting = awaiting;
+    m_sched.m_waits.push_back(this);
+}
+
+void Scheduler::spawn(Task<> task) {
+    m_runnable.push_back(task.m_handle);
+    m_tasks.push_back(std::move(task));
+}
+
+void Scheduler::run() {
+    auto poll_period = std::chrono::nanoseconds{min_poll_period};
+    for (;;) {
+        while (!m_runnable.empty()) {
+            // Resuming may suspend tasks on new awaitables; these only get polled next round
+            for (const auto handle : std::exchange(m_runnable, {}))
+                handle.resume();
+            reap();
+        }
+        if (m_waits.empty())
+            return;
+
+        const auto now = Clock::now();
+        auto next_deadline = Clock::time_point::max();
+        std::erase_if(m_waits, [&](Wait* wait) {
+            wait->m_ready = wait->m_check(*wait);
+            if (!wait->m_ready && now < wait->m_deadline) {
+                next_deadline = std::min(next_deadline, wait->m_deadline);
+                return false;
+            }
+            m_runnable.push_back(wait->m_awaiting);
+            return true;
+        });
+        if (!m_runnable.empty()) {
+            poll_period = min_poll_period;
+            continue;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(poll_period, next_deadline - now));
+        poll_period = std::min<std::chrono::nanoseconds>(2 * poll_period, max_poll_period);
+    }
+}
+
+/// Drops the tasks that are done, rethrowing the first exception that escaped one
+void Scheduler::reap() {
+    std::exception_ptr exception;
+    std::erase_if(m_tasks, [&](const Task<>& task) {
+        if (!task.done())
+            return false;
+        if (!exception)
+            exception = task.m_handle.promise().exception;
+        return true;
+    });
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+} // namespace smce
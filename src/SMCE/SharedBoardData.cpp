@@ -17,6 +17,19 @@
  */
 
 #include "SMCE/internal/SharedBoardData.hpp"
+#include <algorithm>
+#include <bit>
+#include <boost/predef.h>
+
+#if BOOST_OS_LINUX
+extern "C" {
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+}
+#endif
+
+#include "SMCE/BoardConf.hpp"
 
 namespace bip = boost::interprocess;
 
@@ -24,16 +37,148 @@ using ShmSegMan = bip::managed_shared_memory::segment_manager;
 using ShmVoidAllocator = bip::allocator<void, ShmSegMan>;
 
 namespace smce {
+namespace {
+
+constexpr std::size_t page_size = 4096;
+
+/// Faults in all pages of a fresh segment, so that the sketch does not take the page faults while running
+void prefault(void* addr, std::size_t size) noexcept {
+#if BOOST_OS_LINUX && defined(MADV_POPULATE_WRITE)
+    if (::madvise(addr, size, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    // Nothing else accesses the segment yet, so writing bytes back is harmless
+    auto* const bytes = static_cast<volatile char*>(addr);
+    for (std::size_t i = 0; i < size; i += page_size)
+        bytes[i] = bytes[i];
+}
+
+/// Faults in all pages of a segment the other side may be writing to already, hence never writing bytes back
+void prefault_shared(void* addr, std::size_t size) noexcept {
+#if BOOST_OS_LINUX && defined(MADV_POPULATE_WRITE)
+    if (::madvise(addr, size, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    const auto* const bytes = static_cast<const volatile char*>(addr);
+    for (std::size_t i = 0; i < size; i += page_size)
+        static_cast<void>(bytes[i]);
+}
+
+} // namespace
+
+std::size_t SharedBoardData::required_size(const BoardConfig& bconf) noexcept {
+    // Block header and alignment padding of every allocation
+    constexpr std::size_t alloc_overhead = 64;
+
+    // Segment manager, named object index and the board data itself
+    std::size_t size = 2 * page_size + sizeof(BoardData);
+    size += bconf.pins.size() * sizeof(BoardData::Pin) + alloc_overhead;
+    if (!bconf.pins.empty())
+        size += (std::size_t{*std::max_element(bconf.pins.begin(), bconf.pins.end())} + 1) * sizeof(std::uint16_t) +
+                alloc_overhead;
+    size += bconf.pins.size() * sizeof(BoardData::PinValue) + 3 * BoardData::cache_line_size + alloc_overhead;
+    size += bconf.uart_channels.size() * sizeof(BoardData::UartChannel) + alloc_overhead;
+    for (const auto& uart : bconf.uart_channels) {
+        for (const auto length : {uart.rx_buffer_length, uart.tx_buffer_length})
+            size += BoardData::ByteRing::storage_size(static_cast<std::uint16_t>(length), uart.recordable) +
+                    alloc_overhead;
+    }
+    const auto pin_event_capacity = std::min(bconf.pin_event_capacity, BoardConfig::max_pin_event_capacity);
+    size += BoardData::PinEventRing::storage_size(static_cast<std::uint16_t>(pin_event_capacity)) *
+                sizeof(BoardData::PinEvent) +
+            alloc_overhead;
+    size += bconf.sd_cards.size() * sizeof(BoardData::DirectStorage) + alloc_overhead;
+    for (const auto& sd : bconf.sd_cards)
+        size += sd.root_dir.native().size() + 1 + alloc_overhead;
+    size += bconf.frame_buffers.size() * sizeof(BoardData::FrameBuffer) + alloc_overhead;
+    for (const auto& fb : bconf.frame_buffers)
+        size += std::size_t{fb.max_width} * fb.max_height * 3 + alloc_overhead;
+
+    size += size / 8; // fragmentation
+    return (size + page_size - 1) / page_size * page_size;
+}
 
 SharedBoardData::~SharedBoardData() { reset(); }
 
 bool SharedBoardData::configure(std::string_view seg_name, const BoardConfig& bconf) {
     reset();
+    if (bconf.shared_segment.anonymous && configure_anonymous(bconf))
+        return true;
     m_master = true;
     m_name = seg_name;
-    m_shm = bip::managed_shared_memory{bip::create_only, m_name.c_str(), 2 * 1024 * 1024};
+    m_shm = bip::managed_shared_memory{bip::create_only, m_name.c_str(), required_size(bconf)};
     m_bd = m_shm.construct<BoardData>("BoardData")(ShmVoidAllocator{m_shm.get_segment_manager()}, bconf);
+    if (bconf.shared_segment.prefault)
+        prefault(m_shm.get_address(), m_shm.get_size());
+    return true;
+}
+
+bool SharedBoardData::configure_in_process(const BoardConfig& bconf) {
+    reset();
+    const auto size = required_size(bconf);
+    m_heap = std::make_unique_for_overwrite<std::byte[]>(size); // pages get committed as they get used
+    if (bconf.shared_segment.prefault)
+        prefault(m_heap.get(), size);
+    m_buf_seg = BufferSegment{bip::create_only, m_heap.get(), size};
+    m_bd = m_buf_seg.construct<BoardData>("BoardData")(ShmVoidAllocator{m_buf_seg.get_segment_manager()}, bconf);
+    return true;
+}
+
+/**
+ * Creates the segment in an anonymous memory file, to be handed down to the sketch
+ * \return false if unsupported, in which case the caller falls back to a named segment
+ **/
+bool SharedBoardData::configure_anonymous([[maybe_unused]] const BoardConfig& bconf) {
+#if BOOST_OS_LINUX && defined(MFD_CLOEXEC)
+    const auto& seg_conf = bconf.shared_segment;
+    const auto size = required_size(bconf);
+    // Huge pages must be reserved by the admin (vm.nr_hugepages); go for regular ones if there are not enough
+    if (seg_conf.huge_pages) {
+        constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+        const int fd = ::memfd_create("SMCE-Runner", MFD_CLOEXEC | MFD_HUGETLB);
+        if (fd >= 0 && !map_file(fd, (size + huge_page_size - 1) / huge_page_size * huge_page_size, seg_conf.prefault))
+            ::close(fd);
+    }
+    if (m_fd < 0) {
+        const int fd = ::memfd_create("SMCE-Runner", MFD_CLOEXEC);
+        if (fd < 0)
+            return false;
+        if (!map_file(fd, size, seg_conf.prefault)) {
+            ::close(fd);
+            return false;
+        }
+    }
+    m_master = true;
+    m_buf_seg = BufferSegment{bip::create_only, m_map, m_map_size};
+    m_bd = m_buf_seg.construct<BoardData>("BoardData")(ShmVoidAllocator{m_buf_seg.get_segment_manager()}, bconf);
     return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Maps an anonymous memory file, taking ownership of it on success
+ * \param size - size to map; the file is grown to that size if it is new
+ **/
+bool SharedBoardData::map_file([[maybe_unused]] int fd, [[maybe_unused]] std::size_t size,
+                               [[maybe_unused]] bool populate) {
+#if BOOST_OS_LINUX
+    struct ::stat st{};
+    if (::fstat(fd, &st) != 0)
+        return false;
+    if (static_cast<std::size_t>(st.st_size) < size && ::ftruncate(fd, static_cast<::off_t>(size)) != 0)
+        return false;
+    void* const addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+    if (addr == MAP_FAILED)
+        return false;
+    m_fd = fd;
+    m_map = addr;
+    m_map_size = size;
+    return true;
+#else
+    return false;
+#endif
 }
 
 bool SharedBoardData::open_as_child(const char* seg_name) {
@@ -42,16 +187,67 @@ bool SharedBoardData::open_as_child(const char* seg_name) {
     m_name = seg_name;
     m_shm = bip::managed_shared_memory(bip::open_only, seg_name);
     m_bd = m_shm.find<BoardData>("BoardData").first;
+    if (m_bd && m_bd->prefault)
+        prefault_shared(m_shm.get_address(), m_shm.get_size());
     return true;
 }
 
+bool SharedBoardData::open_as_child([[maybe_unused]] int seg_fd) {
+    if (m_bd || m_master)
+        return false;
+#if BOOST_OS_LINUX
+    struct ::stat st{};
+    if (::fstat(seg_fd, &st) != 0 || !map_file(seg_fd, static_cast<std::size_t>(st.st_size), false))
+        return false;
+    m_buf_seg = BufferSegment{bip::open_only, m_map, m_map_size};
+    m_bd = m_buf_seg.find<BoardData>("BoardData").first;
+    // Only known once mapped, hence populated after the fact rather than with MAP_POPULATE
+    if (m_bd && m_bd->prefault)
+        prefault_shared(m_map, m_map_size);
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::size_t SharedBoardData::segment_size() noexcept {
+    if (!m_bd)
+        return 0;
+    return m_heap || m_map ? m_buf_seg.get_size() : m_shm.get_size();
+}
+
+std::size_t SharedBoardData::segment_used() noexcept {
+    if (!m_bd)
+        return 0;
+    return m_heap || m_map ? m_buf_seg.get_size() - m_buf_seg.get_free_memory()
+                           : m_shm.get_size() - m_shm.get_free_memory();
+}
+
 void SharedBoardData::reset() {
-    if (m_bd) {
+    if (m_bd && (m_heap || m_map)) {
+        if (m_heap || m_master)
+            m_buf_seg.destroy<BoardData>("BoardData");
+        m_buf_seg = BufferSegment{};
+        m_heap.reset();
+    } else if (m_bd) {
         if (auto [ptr, off] = m_shm.find<BoardData>("BoardData"); ptr)
             m_shm.destroy<BoardData>("BoardData");
     }
-    if (m_master)
+    m_bd = nullptr;
+#if BOOST_OS_LINUX
+    if (m_map) {
+        ::munmap(m_map, m_map_size);
+        m_map = nullptr;
+        m_map_size = 0;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+    if (m_master && !m_name.empty())
         bip::shared_memory_object::remove(m_name.c_str());
+    m_name.clear();
     m_master = false;
 }
 
@@ -176,6 +176,7 @@ std::error_code Toolchain::do_configure(Sketch& sketch) noexcept {
         "-DSMCE_DIR=" + m_res_dir.string(),
         "-DSKETCH_FQBN=" + sketch.m_conf.fqbn,
         "-DSKETCH_PATH=" + stdfs::absolute(sketch.m_source).generic_string(),
+        std::string{"-DSKETCH_IN_PROCESS="} + (sketch.m_conf.in_process ? "On" : "Off"),
         std::move(libs.pp_remote_arg),
         std::move(libs.cl_remote_arg),
         std::move(libs.cl_local_arg),
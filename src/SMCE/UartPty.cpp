@@ -0,0 +1,156 @@
+/*
+ *  UartPty.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "SMCE/UartPty.hpp"
+
+#include <boost/predef.h>
+#if BOOST_OS_LINUX
+extern "C" {
+#    include <fcntl.h>
+#    include <poll.h>
+#    include <sys/eventfd.h>
+#    include <sys/uio.h>
+#    include <termios.h>
+#    include <unistd.h>
+}
+#    include <array>
+#    include <cerrno>
+#    include <cstdint>
+#    include <cstdlib>
+#endif
+
+namespace smce {
+
+#if BOOST_OS_LINUX
+namespace {
+
+/// Waits for an fd to become ready, or for the stop fd to be signaled; returns false in the latter case
+bool wait_fd(int fd, short events, int stop_fd) noexcept {
+    std::array<::pollfd, 2> fds{{{fd, events, 0}, {stop_fd, POLLIN, 0}}};
+    while (::poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno != EINTR)
+            return false;
+    }
+    return fds[1].revents == 0;
+}
+
+template <class Spans>
+std::array<::iovec, 2> to_iovecs(const Spans& spans) noexcept {
+    return {{{const_cast<char*>(spans.first.data()), spans.first.size()},
+             {const_cast<char*>(spans.second.data()), spans.second.size()}}};
+}
+
+} // namespace
+#endif
+
+UartPty::~UartPty() { stop(); }
+
+bool UartPty::start() noexcept {
+#if BOOST_OS_LINUX
+    if (m_run || !m_uart.exists())
+        return false;
+    m_master = ::posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    std::array<char, 64> name{};
+    if (m_master < 0 || ::grantpt(m_master) != 0 || ::unlockpt(m_master) != 0 ||
+        ::ptsname_r(m_master, name.data(), name.size()) != 0) {
+        stop();
+        return false;
+    }
+    m_slave = ::open(name.data(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    m_stop_fd = ::eventfd(0, EFD_CLOEXEC);
+    ::termios tio{};
+    if (m_slave < 0 || m_stop_fd < 0 || ::tcgetattr(m_slave, &tio) != 0) {
+        stop();
+        return false;
+    }
+    ::cfmakeraw(&tio);
+    ::tcsetattr(m_slave, TCSANOW, &tio);
+
+    m_path = name.data();
+    m_run = true;
+    m_in = std::thread{[&] { pump_in(); }};
+    m_out = std::thread{[&] { pump_out(); }};
+    return true;
+#else
+    return false;
+#endif
+}
+
+void UartPty::stop() noexcept {
+#if BOOST_OS_LINUX
+    m_run = false;
+    if (m_stop_fd >= 0) {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] const auto written = ::write(m_stop_fd, &one, sizeof(one));
+    }
+    for (auto* pump : {&m_in, &m_out}) {
+        if (pump->joinable())
+            pump->join();
+    }
+    for (int* fd : {&m_master, &m_slave, &m_stop_fd}) {
+        if (*fd >= 0)
+            ::close(*fd);
+        *fd = -1;
+    }
+    m_path.clear();
+#endif
+}
+
+/// Moves bytes from the terminal to the rx ring, reading them straight into it
+void UartPty::pump_in() noexcept {
+#if BOOST_OS_LINUX
+    auto rx = m_uart.rx();
+    while (m_run) {
+        const auto room = rx.acquire_write();
+        if (room.size() == 0) {
+            rx.wait_writable(stop_latency);
+            continue;
+        }
+        auto iov = to_iovecs(room);
+        const auto count = ::readv(m_master, iov.data(), room.second.empty() ? 1 : 2);
+        if (count > 0)
+            rx.commit_write(static_cast<std::size_t>(count));
+        else if (count < 0 && errno != EAGAIN && errno != EINTR)
+            return;
+        else if (!wait_fd(m_master, POLLIN, m_stop_fd))
+            return;
+    }
+#endif
+}
+
+/// Moves bytes from the tx ring to the terminal, writing them straight from it
+void UartPty::pump_out() noexcept {
+#if BOOST_OS_LINUX
+    auto tx = m_uart.tx();
+    while (m_run) {
+        if (!tx.wait_readable(stop_latency))
+            continue;
+        const auto data = tx.acquire_read();
+        auto iov = to_iovecs(data);
+        const auto count = ::writev(m_master, iov.data(), data.second.empty() ? 1 : 2);
+        if (count > 0)
+            tx.commit_read(static_cast<std::size_t>(count));
+        else if (count < 0 && errno != EAGAIN && errno != EINTR)
+            return;
+        else if (!wait_fd(m_master, POLLOUT, m_stop_fd))
+            return;
+    }
+#endif
+}
+
+} // namespace smce
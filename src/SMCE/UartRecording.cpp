@@ -0,0 +1,240 @@
+/*
+ *  UartRecording.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "SMCE/UartRecording.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <type_traits>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "SMCE/internal/BoardData.hpp"
+
+namespace bip = boost::interprocess;
+
+namespace smce {
+namespace {
+
+/*
+ * Layout:
+ *   header:     8-byte magic, u32 version, u32 reserved
+ *   per record: i64 board time (ns), u32 length, u16 channel, u8 direction (0 for rx, 1 for tx), u8 reserved,
+ *               then the bytes
+ * A zero length marks the end of the records, as the preallocated space past them is zero-filled.
+ */
+
+constexpr std::array<char, 8> magic{'S', 'M', 'C', 'E', 'U', 'A', 'R', 'T'};
+constexpr std::uint32_t version = 1;
+
+struct FileHeader {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t reserved;
+};
+
+struct RecordHeader {
+    std::int64_t time;
+    std::uint32_t length;
+    std::uint16_t channel;
+    std::uint8_t direction;
+    std::uint8_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader> && sizeof(FileHeader) == 16);
+static_assert(std::is_trivially_copyable_v<RecordHeader> && sizeof(RecordHeader) == 16);
+
+// Chunk a recording thread copies out of a ring at once; a ring never holds more than 64 KiB
+constexpr std::size_t chunk_size = 64 * 1024;
+
+} // namespace
+
+struct UartRecorder::Mapping {
+    bip::file_mapping file;
+    bip::mapped_region region;
+};
+
+struct UartReplayer::Mapping {
+    bip::file_mapping file;
+    bip::mapped_region region;
+};
+
+UartRecorder::UartRecorder(BoardView view) noexcept : m_view{view} {}
+UartRecorder::~UartRecorder() { stop(); }
+
+bool UartRecorder::start(const stdfs::path& path, std::size_t capacity) {
+    if (m_run || !m_view.valid() || capacity < sizeof(FileHeader))
+        return false;
+    // Without slack in the rings, whatever the readers dequeue before the recording threads wake up would be lost
+    const auto& channels = m_view.m_bdat->uart_channels;
+    if (!std::all_of(channels.begin(), channels.end(), [](const auto& chan) { return chan.recordable; }))
+        return false;
+    if (!std::ofstream{path, std::ios::binary | std::ios::trunc})
+        return false;
+    std::error_code ec;
+    stdfs::resize_file(path, capacity, ec); // sparse, so large capacities cost nothing up-front
+    if (ec)
+        return false;
+    try {
+        bip::file_mapping file{path.c_str(), bip::read_write};
+        bip::mapped_region region{file, bip::read_write};
+        m_map = std::make_unique<Mapping>(Mapping{std::move(file), std::move(region)});
+    } catch (const bip::interprocess_exception&) {
+        return false;
+    }
+
+    const FileHeader header{magic, version, 0};
+    std::memcpy(m_map->region.get_address(), &header, sizeof(header));
+    m_end = sizeof(header);
+    m_lost = 0;
+    m_path = path;
+    m_run = true;
+    try {
+        for (std::size_t i = 0; i < m_view.m_bdat->uart_channels.size(); ++i) {
+            // Positions taken up-front, as to record from the moment `start` returns
+            auto& chan = m_view.m_bdat->uart_channels[i];
+            m_threads.emplace_back([this, i, pos = chan.rx.tail.load()] { record(i, false, pos); });
+            m_threads.emplace_back([this, i, pos = chan.tx.tail.load()] { record(i, true, pos); });
+        }
+    } catch (const std::exception&) {
+        stop(); // out of threads or memory; keeps what got recorded meanwhile
+        return false;
+    }
+    return true;
+}
+
+void UartRecorder::stop() noexcept {
+    m_run = false;
+    for (auto& thread : m_threads)
+        thread.join();
+    m_threads.clear();
+    if (!m_map)
+        return;
+    m_map->region.flush();
+    m_map.reset();
+    std::error_code ec;
+    stdfs::resize_file(m_path, m_end, ec);
+}
+
+/// Follows the producer of a ring from a stream position, appending whatever it enqueues
+void UartRecorder::record(std::size_t channel, bool tx, std::uint32_t pos) noexcept {
+    auto& chan = m_view.m_bdat->uart_channels[channel];
+    auto& ring = tx ? chan.tx : chan.rx;
+    auto clock = m_view.clock;
+    std::vector<char> buf(std::min<std::size_t>(ring.data.size(), chunk_size));
+    while (m_run) {
+        if (!ring.wait_enqueued(pos, stop_latency))
+            continue;
+        std::size_t lost;
+        const auto count = ring.snoop(pos, buf, lost);
+        m_lost += lost;
+        if (count != 0)
+            append(channel, tx, clock.now(), {buf.data(), count});
+    }
+}
+
+/// Reserves room at the end of the file without locking, then fills it in; counts the bytes as lost if full
+void UartRecorder::append(std::size_t channel, bool tx, std::chrono::nanoseconds time,
+                          std::span<const char> bytes) noexcept {
+    const auto size = sizeof(RecordHeader) + bytes.size();
+    const auto capacity = m_map->region.get_size();
+    auto end = m_end.load();
+    do {
+        if (capacity - end < size) {
+            m_lost += bytes.size();
+            return;
+        }
+    } while (!m_end.compare_exchange_weak(end, end + size));
+
+    const RecordHeader header{time.count(), static_cast<std::uint32_t>(bytes.size()),
+                              static_cast<std::uint16_t>(channel), static_cast<std::uint8_t>(tx), 0};
+    auto* const out = static_cast<char*>(m_map->region.get_address()) + end;
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), bytes.data(), bytes.size());
+}
+
+UartReplayer::UartReplayer() noexcept = default;
+UartReplayer::~UartReplayer() = default;
+
+bool UartReplayer::open(const stdfs::path& path) {
+    m_records.clear();
+    m_map.reset();
+    try {
+        bip::file_mapping file{path.c_str(), bip::read_only};
+        bip::mapped_region region{file, bip::read_only};
+        m_map = std::make_unique<Mapping>(Mapping{std::move(file), std::move(region)});
+    } catch (const bip::interprocess_exception&) {
+        return false;
+    }
+
+    std::span<const char> in{static_cast<const char*>(m_map->region.get_address()), m_map->region.get_size()};
+    FileHeader file_header;
+    if (in.size() < sizeof(file_header)) {
+        m_map.reset();
+        return false;
+    }
+    std::memcpy(&file_header, in.data(), sizeof(file_header));
+    if (file_header.magic != magic || file_header.version != version) {
+        m_map.reset();
+        return false;
+    }
+    in = in.subspan(sizeof(file_header));
+
+    RecordHeader header;
+    while (in.size() >= sizeof(header)) {
+        std::memcpy(&header, in.data(), sizeof(header));
+        in = in.subspan(sizeof(header));
+        if (header.length == 0 || in.size() < header.length)
+            break; // end of the records, or cut short
+        m_records.push_back({std::chrono::nanoseconds{header.time}, header.channel, header.direction != 0,
+                             in.first(header.length)});
+        in = in.subspan(header.length);
+    }
+    // Threads of distinct buffers may have appended out of time order
+    std::stable_sort(m_records.begin(), m_records.end(),
+                     [](const Record& lhs, const Record& rhs) { return lhs.time < rhs.time; });
+    return true;
+}
+
+std::size_t UartReplayer::replay(BoardView view, Pacing pacing, std::chrono::nanoseconds stall_timeout) const noexcept {
+    const auto first = std::find_if(m_records.begin(), m_records.end(), [](const Record& rec) { return !rec.tx; });
+    if (first == m_records.end() || !view.valid())
+        return 0;
+    const auto start = view.clock.now();
+    std::size_t sent = 0;
+    for (const auto& rec : m_records) {
+        auto uart = view.uart_channels[rec.channel];
+        if (rec.tx || !uart.exists())
+            continue;
+        if (pacing == Pacing::original)
+            view.clock.wait_until(start + (rec.time - first->time));
+        auto rx = uart.rx();
+        for (auto pending = rec.bytes; !pending.empty();) {
+            const auto count = rx.write(pending);
+            sent += count;
+            pending = pending.subspan(count);
+            if (count == 0 && !rx.wait_writable(stall_timeout))
+                return sent;
+        }
+    }
+    return sent;
+}
+
+} // namespace smce
@@ -0,0 +1,97 @@
+/*
+ *  PinLayout.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+/**
+ * Measures the cost of the host and the sketch writing to distinct pins at the same time,
+ * with pin values laid out as in BoardData against interleaved with the rest of the pin data as they used to be.
+ * \note Only meaningful on a machine with at least two cores
+ **/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "SMCE/BoardConf.hpp"
+#include "SMCE/internal/BoardData.hpp"
+#include "SMCE/internal/SharedBoardData.hpp"
+
+namespace {
+
+constexpr std::size_t iterations = 20'000'000;
+
+/// Former layout of `BoardData::Pin`, with the value amidst the rest
+struct InterleavedPin {
+    std::uint16_t id{};
+    bool can_digital_read = false;
+    bool can_digital_write = false;
+    bool can_analog_read = false;
+    bool can_analog_write = false;
+    smce::BoardData::PinValue value = 0;
+    smce::IpcAtomicValue<smce::BoardData::Pin::DataDirection> data_direction = smce::BoardData::Pin::DataDirection::in;
+    smce::IpcAtomicValue<smce::BoardData::Pin::ActiveDriver> active_driver = smce::BoardData::Pin::ActiveDriver::gpio;
+};
+
+/// Has a host and a sketch thread write their own pin value concurrently; returns the time per write in ns
+double ping_pong(smce::BoardData::PinValue& host_value, smce::BoardData::PinValue& sketch_value) {
+    std::atomic<int> ready = 0;
+    const auto writer = [&](smce::BoardData::PinValue& value) {
+        ++ready;
+        while (ready.load() != 2)
+            ;
+        for (std::size_t i = 0; i < iterations; ++i)
+            value.store(static_cast<std::uint16_t>(i));
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread host{writer, std::ref(host_value)};
+    std::thread sketch{writer, std::ref(sketch_value)};
+    host.join();
+    sketch.join();
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+} // namespace
+
+int main() {
+    std::vector<InterleavedPin> interleaved(2);
+    const double before = ping_pong(interleaved[0].value, interleaved[1].value);
+
+    using Drivers = smce::BoardConfig::GpioDrivers;
+    // clang-format off
+    const smce::BoardConfig bconf{
+        .pins = {0, 1},
+        .gpio_drivers = {
+            Drivers{.pin_id = 0, .digital_driver = Drivers::DigitalDriver{.board_read = true, .board_write = false}},
+            Drivers{.pin_id = 1, .digital_driver = Drivers::DigitalDriver{.board_read = false, .board_write = true}},
+        }
+    };
+    // clang-format on
+    smce::SharedBoardData sbdata;
+    sbdata.configure_in_process(bconf);
+    auto& bdat = *sbdata.get_board_data();
+    const double after = ping_pong(bdat.pin_value(0), bdat.pin_value(1));
+
+    std::printf("interleaved values: %6.2f ns/write\n", before);
+    std::printf("separated values:   %6.2f ns/write\n", after);
+    std::printf("speedup:            %6.2fx\n", before / after);
+    if (std::thread::hardware_concurrency() < 2)
+        std::puts("single core; the writers never contended");
+}
@@ -0,0 +1,131 @@
+/*
+ *  UartPty.cpp
+ *  Copyright 2021 ItJustWorksTM
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+/**
+ * Measures the throughput and round-trip latency of a UART channel bridged to a pseudo-terminal,
+ * with a thread echoing everything back in place of a sketch.
+ **/
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+#include "SMCE/BoardConf.hpp"
+#include "SMCE/BoardView.hpp"
+#include "SMCE/UartPty.hpp"
+#include "SMCE/internal/SharedBoardData.hpp"
+
+using namespace std::literals;
+
+namespace {
+
+constexpr std::size_t bulk_size = 16 * 1024 * 1024;
+constexpr std::size_t round_trips = 10'000;
+
+bool write_all(int fd, std::span<const char> bytes) {
+    while (!bytes.empty()) {
+        const auto count = ::write(fd, bytes.data(), bytes.size());
+        if (count <= 0)
+            return false;
+        bytes = bytes.subspan(static_cast<std::size_t>(count));
+    }
+    return true;
+}
+
+bool read_all(int fd, std::span<char> bytes) {
+    while (!bytes.empty()) {
+        const auto count = ::read(fd, bytes.data(), bytes.size());
+        if (count <= 0)
+            return false;
+        bytes = bytes.subspan(static_cast<std::size_t>(count));
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    smce::SharedBoardData sbdata;
+    sbdata.configure_in_process(smce::BoardConfig{.uart_channels = {{}}});
+    smce::BoardView view{*sbdata.get_board_data()};
+    auto uart = view.uart_channels[0];
+
+    smce::UartPty pty{uart};
+    if (!pty.start()) {
+        std::puts("pseudo-terminals unsupported");
+        return EXIT_FAILURE;
+    }
+    const int client = ::open(pty.path().c_str(), O_RDWR | O_NOCTTY);
+    if (client < 0) {
+        std::perror("open");
+        return EXIT_FAILURE;
+    }
+
+    std::atomic_bool run = true;
+    std::thread echo{[&] {
+        std::array<char, 64> buf;
+        while (run) {
+            if (!uart.rx().wait_readable(50ms))
+                continue;
+            std::span<const char> pending{buf.data(), uart.rx().read(buf)};
+            while (run && !pending.empty()) {
+                pending = pending.subspan(uart.tx().write(pending));
+                if (!pending.empty())
+                    uart.tx().wait_writable(50ms);
+            }
+        }
+    }};
+
+    std::vector<char> sent(bulk_size);
+    for (std::size_t i = 0; i < sent.size(); ++i)
+        sent[i] = static_cast<char>(i);
+    std::vector<char> received(bulk_size);
+    auto start = std::chrono::steady_clock::now();
+    std::thread writer{[&] { write_all(client, sent); }};
+    const bool bulk_ok = read_all(client, received) && received == sent;
+    writer.join();
+    const std::chrono::duration<double> bulk_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    bool round_trips_ok = true;
+    for (std::size_t i = 0; i < round_trips && round_trips_ok; ++i) {
+        char c = static_cast<char>(i);
+        round_trips_ok = write_all(client, {&c, 1}) && read_all(client, {&c, 1}) && c == static_cast<char>(i);
+    }
+    const std::chrono::duration<double, std::micro> round_trip_time = std::chrono::steady_clock::now() - start;
+
+    run = false;
+    echo.join();
+    ::close(client);
+    pty.stop();
+
+    if (!bulk_ok || !round_trips_ok) {
+        std::puts("echo mismatch");
+        return EXIT_FAILURE;
+    }
+    std::printf("throughput:         %8.2f MB/s each way\n", bulk_size / bulk_time.count() / 1e6);
+    std::printf("round-trip latency: %8.2f us\n", round_trip_time.count() / round_trips);
+}
@@ -4,11 +4,37 @@
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 #include <catch2/catch.hpp>
 #include "SMCE/Board.hpp"
+#include "SMCE/BoardFleet.hpp"
+#include "SMCE/BoardPool.hpp"
+#include "SMCE/BoardSnapshot.hpp"
+#include "SMCE/BoardView.hpp"
+#include "SMCE/ForkServer.hpp"
+#include "SMCE/RuntimeLog.hpp"
+#include "SMCE/Scheduler.hpp"
 #include "SMCE/Sketch.hpp"
 #include "SMCE/Toolchain.hpp"
+#include "SMCE/UartPty.hpp"
+#include "SMCE/UartRecording.hpp"
+#include "SMCE/internal/BoardData.hpp"
+#include "SMCE/internal/SharedBoardData.hpp"
+#if __linux__
+extern "C" {
+#    include <fcntl.h>
+#    include <poll.h>
+#    include <sys/prctl.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+}
+#endif
 
 #define SMCE_PATH SMCE_TEST_DIR "/smce_root"
 #define SKETCHES_PATH SMCE_TEST_DIR "/sketches/"
@@ -32,6 +58,77 @@ TEST_CASE("ExecutionContext valid", "[ExecutionContext]") {
     REQUIRE_FALSE(tc.cmake_path().empty());
 }
 
+TEST_CASE("RuntimeLog ring", "[RuntimeLog]") {
+    smce::RuntimeLog log{10};
+    REQUIRE(log.capacity() == 16);
+    REQUIRE(log.read(0).size() == 0);
+
+    log.write("0123456789"sv);
+    auto chunk = log.read(0);
+    REQUIRE(chunk.begin == 0);
+    REQUIRE(chunk.end == 10);
+    REQUIRE(std::string_view{chunk.first.data(), chunk.first.size()} == "0123456789");
+    REQUIRE(chunk.second.empty());
+    REQUIRE(log.intact(chunk));
+
+    const auto cursor = chunk.end;
+    log.write("abcdefghij"sv); // wraps around, overwriting "0123"
+    REQUIRE(!log.intact(chunk));
+    REQUIRE(log.begin() == 4);
+    chunk = log.read(cursor);
+    REQUIRE(chunk.begin == cursor);
+    REQUIRE(chunk.first.size() == 6);
+    REQUIRE(chunk.second.size() == 4);
+    REQUIRE(log.copy(cursor) == "abcdefghij");
+    REQUIRE(log.copy() == "456789abcdefghij");
+
+    log.clear();
+    REQUIRE(log.copy().empty());
+    REQUIRE(log.end() == 20);
+}
+
+TEST_CASE("IpcMovableMutex contention", "[BoardData]") {
+    smce::IpcMovableMutex mut;
+    int count = 0;
+    const auto work = [&] {
+        for (int i = 0; i < 10'000; ++i) {
+            [[maybe_unused]] std::lock_guard lk{mut};
+            ++count;
+        }
+    };
+    std::thread other{work};
+    work();
+    other.join();
+    REQUIRE(count == 20'000);
+    REQUIRE(mut.try_lock());
+    REQUIRE_FALSE(mut.try_lock());
+    mut.unlock();
+
+#if __linux__
+    // A lock held by a process which then died gets taken over
+    const auto pid = ::fork();
+    if (pid == 0)
+        ::_exit(0);
+    REQUIRE(::waitpid(pid, nullptr, 0) == pid);
+    mut.state = smce::IpcMovableMutex::locked;
+    mut.owner = pid;
+    mut.lock();
+    mut.unlock();
+    REQUIRE(mut.state == smce::IpcMovableMutex::unlocked);
+
+    // Even while it is dead but not reaped yet, as sketches are until their board gets ticked
+    const auto zombie = ::fork();
+    if (zombie == 0)
+        ::_exit(0);
+    mut.state = smce::IpcMovableMutex::locked;
+    mut.owner = zombie;
+    mut.lock();
+    mut.unlock();
+    REQUIRE(mut.state == smce::IpcMovableMutex::unlocked);
+    REQUIRE(::waitpid(zombie, nullptr, 0) == zombie);
+#endif
+}
+
 TEST_CASE("BoardRunner contracts", "[BoardRunner]") {
     smce::Toolchain tc{SMCE_PATH};
     REQUIRE(!tc.check_suitable_environment());
@@ -87,6 +184,7 @@ TEST_CASE("BoardRunner exit_notify", "[BoardRunner]") {
     }
     REQUIRE(exfut.wait_for(0ms) == std::future_status::ready);
     REQUIRE(exfut.get() != 0);
+    REQUIRE(br.runtime_log().copy().find("exception") != std::string::npos);
 }
 
 template <class Pin, class Value, class Duration>
@@ -133,13 +231,15 @@ TEST_CASE("BoardView GPIO", "[BoardView]") {
                     .board_write = true
                 }
             },
-        }
+        },
+        .pin_event_capacity = 16
     }));
     // clang-format on
     REQUIRE(br.attach_sketch(sk));
     REQUIRE(br.start());
     auto bv = br.view();
     REQUIRE(bv.valid());
+    REQUIRE(bv.pin_events.exists());
     auto pin0 = bv.pins[0].digital();
     REQUIRE(pin0.exists());
     auto pin1 = bv.pins[1].digital();
@@ -152,9 +252,45 @@ TEST_CASE("BoardView GPIO", "[BoardView]") {
     test_pin_delayable(pin2, true, 16384, 1ms);
     pin0.write(true);
     test_pin_delayable(pin2, false, 16384, 1ms);
+
+    // The sketch rewrites pin 2 every loop, but only its two changes are queued
+    REQUIRE(bv.pin_events.wait(0ms));
+    std::array<smce::PinEvent, 16> events;
+    REQUIRE(bv.pin_events.read(events) == 2);
+    REQUIRE(events[0].pin == 2);
+    REQUIRE(events[0].value == 255);
+    REQUIRE(events[1].pin == 2);
+    REQUIRE(events[1].value == 0);
+    REQUIRE(events[0].time <= events[1].time);
+    REQUIRE(bv.pin_events.dropped() == 0);
+    REQUIRE_FALSE(bv.pin_events.wait(1ms));
+
+    REQUIRE(bv.pins.size() == 2);
+    std::array<smce::PinState, 4> states;
+    REQUIRE(bv.pins.read(states) == 2);
+    REQUIRE(states[0].id == 0);
+    REQUIRE(states[0].value == 255);
+    REQUIRE(states[0].direction == smce::VirtualPin::DataDirection::in);
+    REQUIRE(states[1].id == 2);
+    REQUIRE(states[1].value == 0);
+    REQUIRE(states[1].direction == smce::VirtualPin::DataDirection::out);
+    const std::array<smce::PinWrite, 2> writes{{{0, 0}, {1, 255}}};
+    REQUIRE(bv.pins.write(writes) == 1);
+    test_pin_delayable(pin2, true, 16384, 1ms);
     REQUIRE(br.stop());
 }
 
+TEST_CASE("Pin event capacity", "[BoardView]") {
+    // Capacities past the largest one get clamped, rather than wrapped around
+    for (const std::size_t capacity : {std::size_t{65536}, std::size_t{70000}}) {
+        smce::SharedBoardData sbdata;
+        REQUIRE(sbdata.configure_in_process({.pins = {0}, .pin_event_capacity = capacity}));
+        smce::BoardView bv{*sbdata.get_board_data()};
+        REQUIRE(bv.pin_events.exists());
+        REQUIRE(sbdata.get_board_data()->pin_events.capacity == smce::BoardConfig::max_pin_event_capacity);
+    }
+}
+
 TEST_CASE("BoardView UART", "[BoardView]") {
     smce::Toolchain tc{SMCE_PATH};
     REQUIRE(!tc.check_suitable_environment());
@@ -177,7 +313,9 @@ TEST_CASE("BoardView UART", "[BoardView]") {
     REQUIRE_FALSE(uart1.exists());
     REQUIRE_FALSE(uart1.rx().exists());
     REQUIRE_FALSE(uart1.tx().exists());
-    std::this_thread::sleep_for(1ms);
+    REQUIRE_FALSE(uart1.tx().wait_readable(1ms));
+    REQUIRE_FALSE(uart0.tx().wait_readable(1ms));
+    REQUIRE(uart0.rx().wait_writable(1ms));
 
     std::array out = {'H', 'E', 'L', 'L', 'O', ' ', 'U', 'A', 'R', 'T', '\0'};
     std::array<char, out.size()> in{};
@@ -186,7 +324,7 @@ TEST_CASE("BoardView UART", "[BoardView]") {
     do {
         if (ticks-- == 0)
             FAIL();
-        std::this_thread::sleep_for(1ms);
+        uart0.tx().wait_readable(1ms);
     } while (uart0.tx().read(in) != in.size());
     REQUIRE(in == out);
 
@@ -196,11 +334,899 @@ TEST_CASE("BoardView UART", "[BoardView]") {
     do {
         if (ticks-- == 0)
             FAIL();
-        std::this_thread::sleep_for(1ms);
+        uart0.tx().wait_readable(1ms);
+    } while (uart0.tx().read(in) != in.size());
+    REQUIRE(in == out);
+
+    // Same round-trip, in place
+    auto room = uart0.rx().acquire_write();
+    REQUIRE(room.size() == uart0.rx().max_size());
+    std::copy_n("ZERO", 4, room.first.begin());
+    uart0.rx().commit_write(4);
+    smce::VirtualUartBuffer::Spans<const char> echoed;
+    ticks = 16'000;
+    while ((echoed = uart0.tx().acquire_read()).size() < 4) {
+        if (ticks-- == 0)
+            FAIL();
+        uart0.tx().wait_readable(1ms);
+    }
+    std::string echoed_str{echoed.first.begin(), echoed.first.end()};
+    echoed_str.append(echoed.second.begin(), echoed.second.end());
+    REQUIRE(echoed_str == "ZERO");
+    uart0.tx().commit_read(echoed.size());
+    REQUIRE(uart0.tx().size() == 0);
+
+    const auto stats = br.stats();
+    REQUIRE(stats.uptime > 0ns);
+    REQUIRE(stats.shm_used > 0);
+    REQUIRE(stats.shm_used <= stats.shm_size);
+#if __linux__
+    REQUIRE(stats.rss > 0);
+    REQUIRE(stats.voluntary_switches + stats.involuntary_switches > 0);
+#endif
+
+    REQUIRE(br.stop());
+    REQUIRE(br.stats().shm_size == 0);
+}
+
+TEST_CASE("BoardSnapshot diffs", "[BoardSnapshot]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "pins", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    // clang-format off
+    REQUIRE(br.configure({
+        .pins = {0, 2},
+        .gpio_drivers = {
+            smce::BoardConfig::GpioDrivers{
+                .pin_id = 0,
+                .digital_driver = smce::BoardConfig::GpioDrivers::DigitalDriver{.board_read = true, .board_write = false}
+            },
+            smce::BoardConfig::GpioDrivers{
+                .pin_id = 2,
+                .digital_driver = smce::BoardConfig::GpioDrivers::DigitalDriver{.board_read = false, .board_write = true}
+            },
+        },
+        .uart_channels = {{}}
+    }));
+    // clang-format on
+    REQUIRE(smce::BoardSnapshot::capture(br.view()).empty());
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto bv = br.view();
+    REQUIRE(bv.valid());
+    auto pin0 = bv.pins[0].digital();
+    auto pin2 = bv.pins[2].digital();
+
+    pin0.write(false);
+    test_pin_delayable(pin2, true, 16384, 1ms);
+    auto mirror = smce::BoardSnapshot::capture(bv);
+    REQUIRE_FALSE(mirror.empty());
+    REQUIRE(smce::BoardSnapshot::capture(bv) == mirror);
+    REQUIRE(smce::BoardSnapshot::capture(bv).diff_from(mirror).empty());
+
+    pin0.write(true);
+    test_pin_delayable(pin2, false, 16384, 1ms);
+    constexpr std::array msg = {'S', 'N', 'A', 'P'};
+    REQUIRE(bv.uart_channels[0].rx().write(msg) == msg.size());
+    const auto current = smce::BoardSnapshot::capture(bv);
+    REQUIRE(current != mirror);
+    const auto diff = current.diff_from(mirror);
+    REQUIRE_FALSE(diff.empty());
+    REQUIRE(diff.bytes.size() < current.bytes().size());
+    REQUIRE(mirror.apply(diff));
+    REQUIRE(mirror == current);
+
+    smce::BoardSnapshot fresh;
+    REQUIRE(fresh.apply(current.diff_from(fresh)));
+    REQUIRE(fresh == current);
+    REQUIRE_FALSE(fresh.apply({}));
+    REQUIRE(br.stop());
+}
+
+TEST_CASE("Board segment sizing", "[Board]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    smce::Board small{};
+    REQUIRE(small.configure({.uart_channels = {{}}}));
+    REQUIRE(small.attach_sketch(sk));
+    REQUIRE(small.start());
+    REQUIRE(small.stats().shm_size < 64 * 1024);
+    REQUIRE(small.stop());
+
+    using Fb = smce::BoardConfig::FrameBuffer;
+    smce::Board cameras{};
+    // clang-format off
+    REQUIRE(cameras.configure({
+        .uart_channels = {{.rx_buffer_length = 4096, .tx_buffer_length = 4096}},
+        .frame_buffers = {{1, Fb::Direction::in}, {2, Fb::Direction::in}, {3, Fb::Direction::in}}
+    }));
+    // clang-format on
+    REQUIRE(cameras.attach_sketch(sk));
+    REQUIRE(cameras.start());
+    auto bv = cameras.view();
+    std::vector<std::byte> frame(640 * 480 * 3);
+    for (std::size_t key = 1; key <= 3; ++key) {
+        auto fb = bv.frame_buffers[key];
+        REQUIRE(fb.exists());
+        fb.set_width(640);
+        fb.set_height(480);
+        REQUIRE(fb.get_width() == 640);
+        REQUIRE(fb.get_height() == 480);
+        REQUIRE(fb.write_rgb888(frame));
+    }
+    auto fb = bv.frame_buffers[1];
+    fb.set_width(std::numeric_limits<std::uint16_t>::max());
+    REQUIRE(fb.get_width() == 640);
+    REQUIRE(fb.read_rgb888(frame));
+    REQUIRE(cameras.stop());
+}
+
+TEST_CASE("Board anonymous segment", "[Board]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    smce::ForkServer fs{sk};
+    for (auto* fork_server : {static_cast<smce::ForkServer*>(nullptr), &fs}) {
+        smce::Board br{};
+        // clang-format off
+        REQUIRE(br.configure({
+            .uart_channels = {{}},
+            .shared_segment = {.anonymous = true, .huge_pages = true, .prefault = true}
+        }));
+        // clang-format on
+        REQUIRE(br.attach_sketch(sk));
+        REQUIRE(br.attach_fork_server(fork_server));
+        REQUIRE(br.start());
+#if __linux__
+        for (const auto& entry : std::filesystem::directory_iterator{"/dev/shm"})
+            REQUIRE(entry.path().filename().string().find("SMCE-Runner-") == std::string::npos);
+#endif
+        auto uart0 = br.view().uart_channels[0];
+        std::array out = {'M', 'E', 'M', 'F', 'D'};
+        std::array<char, out.size()> in{};
+        uart0.rx().write(out);
+        int ticks = 16'000;
+        do {
+            if (ticks-- == 0)
+                FAIL();
+            uart0.tx().wait_readable(1ms);
+        } while (uart0.tx().read(in) != in.size());
+        REQUIRE(in == out);
+        REQUIRE(br.stop());
+    }
+}
+
+TEST_CASE("BoardView UART staging busy-wait", "[BoardView]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "busy_wait", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    // Below the flushing threshold, and the sketch then spins on millis() without ever sleeping nor looping
+    REQUIRE(br.configure({.uart_channels = {{.flushing_threshold = 32}}}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto uart0 = br.view().uart_channels[0];
+    std::string received;
+    int ticks = 16'000;
+    while (received.size() < 4) {
+        if (ticks-- == 0)
+            FAIL();
+        uart0.tx().wait_readable(1ms);
+        std::array<char, 8> buf;
+        received.append(buf.data(), uart0.tx().read(buf));
+    }
+    REQUIRE(received == "BUSY");
+    REQUIRE(br.stop());
+}
+
+TEST_CASE("BoardView UART timed reads", "[BoardView]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "read_bytes", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    REQUIRE(br.configure({.uart_channels = {{}}}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto uart0 = br.view().uart_channels[0];
+    REQUIRE(uart0.rx().wait_writable(1s));
+    REQUIRE(uart0.rx().write(std::string_view{"ABCD"}) == 4);
+    // readBytes waits for the rest of the bytes (within its timeout) instead of returning what came so far
+    REQUIRE_FALSE(uart0.tx().wait_readable(50ms));
+    REQUIRE(uart0.rx().write(std::string_view{"EFGH"}) == 4);
+    std::string received;
+    int ticks = 16'000;
+    while (received.size() < 8) {
+        if (ticks-- == 0)
+            FAIL();
+        uart0.tx().wait_readable(1ms);
+        std::array<char, 8> buf;
+        received.append(buf.data(), uart0.tx().read(buf));
+    }
+    REQUIRE(received == "ABCDEFGH");
+    REQUIRE(br.stop());
+}
+
+TEST_CASE("BoardView UART streaming", "[BoardView]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    // The sketch stages its output, publishing it by chunks of 32 bytes or at the end of each loop
+    REQUIRE(br.configure(
+        {.uart_channels = {{.rx_buffer_length = 100, .tx_buffer_length = 100, .flushing_threshold = 32}}}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto uart0 = br.view().uart_channels[0];
+    REQUIRE(uart0.rx().max_size() == 100);
+    REQUIRE(uart0.flushing_threshold() == 32);
+
+    // Many times the size of the rings, so that their positions wrap around
+    std::string sent(64 * 1024, '\0');
+    for (std::size_t i = 0; i < sent.size(); ++i)
+        sent[i] = static_cast<char>('a' + i % 26);
+    std::string received;
+    std::array<char, 100> buf;
+    for (std::size_t pos = 0; pos < sent.size();) {
+        pos += uart0.rx().write(std::string_view{sent}.substr(pos, 100));
+        int ticks = 16'000;
+        while (received.size() < pos) {
+            if (ticks-- == 0)
+                FAIL();
+            uart0.tx().wait_readable(1ms);
+            received.append(buf.data(), uart0.tx().read(buf));
+        }
+    }
+    REQUIRE(received == sent);
+    REQUIRE(uart0.tx().size() == 0);
+    REQUIRE(br.stop());
+}
+
+TEST_CASE("BoardView UART pacing", "[BoardView]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    // 100 bytes per second of board time, which only moves when stepped
+    REQUIRE(br.configure({.uart_channels = {{.baud_rate = 1000, .paced = true}}, .clock_speed_factor = 0}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto uart0 = br.view().uart_channels[0];
+    auto clock = br.view().clock;
+    REQUIRE(uart0.is_paced());
+
+    std::array out = {'P', 'A', 'C', 'E', 'D'};
+    std::array<char, out.size()> in{};
+    REQUIRE(uart0.rx().write(out) == out.size());
+    REQUIRE(uart0.rx().size() == 0); // still going through the line
+    REQUIRE_FALSE(uart0.tx().wait_readable(20ms));
+    clock.advance(50ms); // the sketch gets the bytes, and echoes them back through the tx line
+    std::this_thread::sleep_for(50ms);
+    REQUIRE_FALSE(uart0.tx().wait_readable(0ms));
+    uart0.tx().commit_read(out.size()); // no-op, as nothing got handed out yet
+    clock.advance(50ms);
+    REQUIRE(uart0.tx().wait_readable(1s));
+    REQUIRE(uart0.tx().read(in) == in.size());
+    REQUIRE(in == out);
+
+    // At maximum speed, bytes get through without board time moving
+    uart0.set_paced(false);
+    REQUIRE_FALSE(uart0.is_paced());
+    std::reverse(out.begin(), out.end());
+    uart0.rx().write(out);
+    int ticks = 16'000;
+    do {
+        if (ticks-- == 0)
+            FAIL();
+        uart0.tx().wait_readable(1ms);
     } while (uart0.tx().read(in) != in.size());
     REQUIRE(in == out);
+    REQUIRE(br.stop());
+}
+
+#if __linux__
+TEST_CASE("UartPty bridge", "[UartPty]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    REQUIRE(br.configure({.uart_channels = {{}}}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+
+    smce::UartPty pty{br.view().uart_channels[0]};
+    REQUIRE(pty.start());
+    REQUIRE(pty.running());
+    REQUIRE_FALSE(pty.start());
+    const int client = ::open(pty.path().c_str(), O_RDWR | O_NOCTTY);
+    REQUIRE(client >= 0);
+
+    constexpr std::string_view out = "HELLO PTY";
+    REQUIRE(::write(client, out.data(), out.size()) == static_cast<ssize_t>(out.size()));
+    std::string in;
+    while (in.size() < out.size()) {
+        ::pollfd pfd{client, POLLIN, 0};
+        REQUIRE(::poll(&pfd, 1, 16'000) == 1);
+        std::array<char, 16> buf;
+        const auto count = ::read(client, buf.data(), buf.size());
+        REQUIRE(count > 0);
+        in.append(buf.data(), static_cast<std::size_t>(count));
+    }
+    REQUIRE(in == out);
+
+    ::close(client);
+    pty.stop();
+    REQUIRE_FALSE(pty.running());
+    REQUIRE(pty.path().empty());
+    REQUIRE(br.stop());
+}
+#endif
+
+TEST_CASE("UartRecorder round-trip", "[UartRecording]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    REQUIRE(br.configure({.uart_channels = {{.recordable = true}}}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto uart = br.view().uart_channels[0];
+
+    const auto read_echo = [&](std::size_t size) {
+        std::string in;
+        while (in.size() < size && uart.tx().wait_readable(16s)) {
+            std::array<char, 16> buf;
+            in.append(buf.data(), uart.tx().read(buf));
+        }
+        return in;
+    };
 
+    const auto path = std::filesystem::temp_directory_path() / "smce_uart_recording.bin";
+    {
+        // Boards with a channel not leaving room for the recorder would silently lose traffic
+        smce::Board unrecordable{};
+        REQUIRE(unrecordable.configure({.uart_channels = {{.recordable = true}, {}}}));
+        REQUIRE(unrecordable.attach_sketch(sk));
+        REQUIRE(unrecordable.start());
+        smce::UartRecorder recorder{unrecordable.view()};
+        REQUIRE_FALSE(recorder.start(path));
+        REQUIRE_FALSE(recorder.running());
+        REQUIRE(unrecordable.stop());
+    }
+    smce::UartRecorder recorder{br.view()};
+    REQUIRE(recorder.start(path));
+    REQUIRE(recorder.running());
+    REQUIRE_FALSE(recorder.start(path));
+    constexpr std::string_view out = "HELLO RECORDER";
+    REQUIRE(uart.rx().write(out) == out.size());
+    REQUIRE(read_echo(out.size()) == out);
+    recorder.stop();
+    REQUIRE_FALSE(recorder.running());
+    REQUIRE(recorder.lost() == 0);
+
+    smce::UartReplayer replayer;
+    REQUIRE(replayer.open(path));
+    std::string recorded_rx, recorded_tx;
+    auto last_time = 0ns;
+    for (const auto& rec : replayer.records()) {
+        REQUIRE(rec.channel == 0);
+        REQUIRE(rec.time >= last_time);
+        (rec.tx ? recorded_tx : recorded_rx).append(rec.bytes.begin(), rec.bytes.end());
+        last_time = rec.time;
+    }
+    REQUIRE(recorded_rx == out);
+    REQUIRE(recorded_tx == out);
+
+    REQUIRE(replayer.replay(br.view(), smce::UartReplayer::Pacing::max_speed) == out.size());
+    REQUIRE(read_echo(out.size()) == out);
+    REQUIRE(replayer.replay(br.view(), smce::UartReplayer::Pacing::original) == out.size());
+    REQUIRE(read_echo(out.size()) == out);
+
+    REQUIRE_FALSE(replayer.open(SKETCHES_PATH "uart/uart.ino"));
+    REQUIRE(replayer.records().empty());
+    REQUIRE(br.stop());
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Scheduler awaitables", "[Scheduler]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch pins_sk{SKETCHES_PATH "pins", {.fqbn = "arduino:avr:nano"}};
+    smce::Sketch uart_sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    for (auto* sk : {&pins_sk, &uart_sk}) {
+        const auto ec = tc.compile(*sk);
+        if (ec)
+            std::cerr << tc.build_log().second;
+        REQUIRE_FALSE(ec);
+    }
+    using Fb = smce::BoardConfig::FrameBuffer;
+    smce::Board pins_br{};
+    // clang-format off
+    REQUIRE(pins_br.configure({
+        .pins = {0, 2},
+        .gpio_drivers = {
+            smce::BoardConfig::GpioDrivers {
+                .pin_id = 0,
+                .digital_driver = smce::BoardConfig::GpioDrivers::DigitalDriver{
+                    .board_read = true,
+                    .board_write = false
+                }
+            },
+            smce::BoardConfig::GpioDrivers {
+                .pin_id = 2,
+                .digital_driver = smce::BoardConfig::GpioDrivers::DigitalDriver{
+                    .board_read = false,
+                    .board_write = true
+                }
+            },
+        },
+        .frame_buffers = {{1, Fb::Direction::in, 4, 4}}
+    }));
+    // clang-format on
+    REQUIRE(pins_br.attach_sketch(pins_sk));
+    smce::Board uart_br{};
+    REQUIRE(uart_br.configure({.uart_channels = {{}}}));
+    REQUIRE(uart_br.attach_sketch(uart_sk));
+    REQUIRE(pins_br.start());
+    REQUIRE(uart_br.start());
+
+    auto pin0 = pins_br.view().pins[0].digital();
+    auto pin2 = pins_br.view().pins[2].digital();
+    auto fb = pins_br.view().frame_buffers[1];
+    fb.set_width(4);
+    fb.set_height(4);
+    auto uart = uart_br.view().uart_channels[0];
+    smce::Scheduler sched;
+
+    // Plenty of tasks waiting at once, all driven by this thread
+    constexpr std::size_t watchers = 1000;
+    std::size_t woken = 0;
+    const auto watch = [&]() -> smce::Task<> {
+        if (co_await sched.pin_equals(pin2, true, 16s))
+            ++woken;
+    };
+    for (std::size_t i = 0; i < watchers; ++i)
+        sched.spawn(watch());
+
+    const auto echo = [&](std::string_view out) -> smce::Task<std::string> {
+        uart.rx().write(out);
+        std::string in(out.size(), '\0');
+        if (co_await sched.bytes(uart.tx(), in.size(), 16s))
+            uart.tx().read(in);
+        co_return in;
+    };
+    const auto film = [&]() -> smce::Task<> {
+        co_await sched.sleep_for(10ms);
+        std::vector<std::byte> frame(4 * 4 * 3);
+        fb.write_rgb888(frame);
+    };
+    bool done = false;
+    const auto drive = [&]() -> smce::Task<> {
+        pin0.write(false);
+        bool ready = co_await sched.pin_equals(pin2, true, 16s);
+        REQUIRE(ready);
+        pin0.write(true);
+        ready = co_await sched.pin_equals(pin2, false, 16s);
+        REQUIRE(ready);
+
+        const auto in = co_await echo("HELLO SCHEDULER");
+        REQUIRE(in == "HELLO SCHEDULER");
+        ready = co_await sched.bytes(uart.tx(), 1, 10ms);
+        REQUIRE_FALSE(ready);
+
+        sched.spawn(film());
+        ready = co_await sched.frame_update(fb, 16s);
+        REQUIRE(ready);
+        done = true;
+    };
+    sched.spawn(drive());
+    sched.run();
+    REQUIRE(done);
+    REQUIRE(woken == watchers);
+    REQUIRE(sched.pending() == 0);
+
+    sched.spawn([]() -> smce::Task<> {
+        throw std::runtime_error{"task failure"};
+        co_return;
+    }());
+    REQUIRE_THROWS_AS(sched.run(), std::runtime_error);
+    REQUIRE(sched.pending() == 0);
+
+    REQUIRE(pins_br.stop());
+    REQUIRE(uart_br.stop());
+}
+
+TEST_CASE("BoardView clock", "[BoardView]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "clock", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    const auto read_millis = [](smce::VirtualUart uart, int ticks) -> std::optional<unsigned long> {
+        std::string line;
+        while (ticks-- > 0) {
+            std::array<char, 16> buf;
+            const auto count = uart.tx().read(buf);
+            line.append(buf.data(), count);
+            if (const auto eol = line.find('\n'); eol != std::string::npos)
+                return std::stoul(line.substr(0, eol));
+            uart.tx().wait_readable(1ms);
+        }
+        return std::nullopt;
+    };
+
+    smce::Board br{};
+    REQUIRE(br.configure({.uart_channels = {{}}, .clock_speed_factor = 1000}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto clock = br.view().clock;
+    REQUIRE(clock.exists());
+    REQUIRE(clock.speed_factor() == 1000);
+    const auto fast_millis = read_millis(br.view().uart_channels[0], 4'000);
+    REQUIRE(fast_millis);
+    REQUIRE(*fast_millis >= 10'000);
+
+    clock.set_speed_factor(0);
+    const auto frozen = clock.now();
+    std::this_thread::sleep_for(20ms);
+    REQUIRE(clock.now() == frozen);
+    for (std::array<char, 64> buf; br.view().uart_channels[0].tx().read(buf) != 0;)
+        ; // drop what got printed before freezing
+    clock.advance(1h);
+    REQUIRE(clock.now() == frozen + 1h);
+    const auto stepped_millis = read_millis(br.view().uart_channels[0], 4'000);
+    REQUIRE(stepped_millis);
+    REQUIRE(*stepped_millis >= 3'600'000);
+    REQUIRE(br.stop());
+}
+
+TEST_CASE("BoardFleet bulk lifecycle", "[BoardFleet]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    constexpr std::size_t fleet_size = 8;
+    smce::BoardFleet fleet;
+    REQUIRE(fleet.add(fleet_size) == 0);
+    REQUIRE(fleet.size() == fleet_size);
+    REQUIRE(fleet.configure({.uart_channels = {{}}}) == fleet_size);
+    REQUIRE(fleet.attach_sketch(sk) == fleet_size);
+    REQUIRE(fleet.start() == fleet_size);
+    REQUIRE(fleet.stats().running == fleet_size);
+
+    for (std::size_t i = 0; i < fleet.size(); ++i) {
+        auto uart0 = fleet[i].view().uart_channels[0];
+        std::array out = {'F', 'L', 'E', 'E', 'T'};
+        std::array<char, out.size()> in{};
+        uart0.rx().write(out);
+        int ticks = 16'000;
+        do {
+            if (ticks-- == 0)
+                FAIL();
+            uart0.tx().wait_readable(1ms);
+        } while (uart0.tx().read(in) != in.size());
+        REQUIRE(in == out);
+    }
+
+    REQUIRE(fleet.suspend() == fleet_size);
+    REQUIRE(fleet.stats().suspended == fleet_size);
+    REQUIRE(fleet.resume() == fleet_size);
+    REQUIRE(fleet.stop() == fleet_size);
+    fleet.tick();
+    const auto stats = fleet.stats();
+    REQUIRE(stats.stopped == fleet_size);
+    REQUIRE(stats.exits == 0);
+}
+
+TEST_CASE("BoardFleet exits", "[BoardFleet]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uncaught", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    constexpr std::size_t fleet_size = 4;
+    std::vector<std::size_t> exited;
+    smce::BoardFleet fleet{[&](std::size_t idx, int ec) {
+        REQUIRE(ec != 0);
+        exited.push_back(idx);
+    }};
+    fleet.add(fleet_size);
+    REQUIRE(fleet.configure({}) == fleet_size);
+    REQUIRE(fleet.attach_sketch(sk) == fleet_size);
+    REQUIRE(fleet.start() == fleet_size);
+    int ticks = 5'000;
+    while (exited.size() != fleet_size && ticks-- > 0) {
+        std::this_thread::sleep_for(1ms);
+        fleet.tick();
+    }
+    REQUIRE(exited.size() == fleet_size);
+    const auto stats = fleet.stats();
+    REQUIRE(stats.exits == fleet_size);
+    REQUIRE(stats.stopped == fleet_size);
+    REQUIRE(stats.log_bytes > 0);
+    for (std::size_t i = 0; i < fleet.size(); ++i)
+        REQUIRE(fleet[i].runtime_log().end() > 0);
+}
+
+TEST_CASE("BoardPool hand-out", "[BoardPool]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    const smce::BoardConfig bconf{.uart_channels = {{}}};
+    smce::BoardPool pool{sk, bconf, 2};
+    REQUIRE(pool.warm_up());
+    REQUIRE(pool.available() == 2);
+
+    smce::Board br{};
+    REQUIRE(br.configure(bconf));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.attach_pool(&pool));
+    for (int i = 0; i < 2; ++i) {
+        REQUIRE(br.start());
+        auto uart0 = br.view().uart_channels[0];
+        REQUIRE(uart0.exists());
+        std::array out = {'P', 'O', 'O', 'L'};
+        std::array<char, out.size()> in{};
+        uart0.rx().write(out);
+        int ticks = 16'000;
+        do {
+            if (ticks-- == 0)
+                FAIL();
+            uart0.tx().wait_readable(1ms);
+        } while (uart0.tx().read(in) != in.size());
+        REQUIRE(in == out);
+        REQUIRE(br.stop());
+    }
+
+    smce::Board other{};
+    REQUIRE(other.configure({}));
+    REQUIRE(other.attach_sketch(sk));
+    REQUIRE(other.attach_pool(&pool));
+    REQUIRE(other.start()); // configuration mismatch; spawns on its own
+    REQUIRE(other.stop());
+
+    const auto metrics = pool.metrics();
+    REQUIRE(metrics.hits == 2);
+    REQUIRE(metrics.misses == 1);
+    REQUIRE(metrics.max_start_latency >= metrics.last_start_latency);
+}
+
+#if __linux__
+
+TEST_CASE("ForkServer spawning", "[ForkServer]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    smce::ForkServer fs{sk};
+    REQUIRE(fs.valid());
+    std::array<smce::Board, 2> boards;
+    for (auto& br : boards) {
+        REQUIRE(br.configure({.uart_channels = {{}}}));
+        REQUIRE(br.attach_sketch(sk));
+        REQUIRE(br.attach_fork_server(&fs));
+        REQUIRE(br.start());
+    }
+#if __linux__
+    // Only a subreaper while handing sketches over, as to not adopt the host's other orphaned descendants
+    int subreaper = -1;
+    REQUIRE(::prctl(PR_GET_CHILD_SUBREAPER, &subreaper) == 0);
+    REQUIRE(subreaper == 0);
+#endif
+    for (auto& br : boards) {
+        auto uart0 = br.view().uart_channels[0];
+        std::array out = {'F', 'O', 'R', 'K'};
+        std::array<char, out.size()> in{};
+        uart0.rx().write(out);
+        int ticks = 16'000;
+        do {
+            if (ticks-- == 0)
+                FAIL();
+            uart0.tx().wait_readable(1ms);
+        } while (uart0.tx().read(in) != in.size());
+        REQUIRE(in == out);
+        REQUIRE(br.stop());
+    }
+    REQUIRE(fs.valid());
+}
+
+TEST_CASE("ForkServer exit_notify", "[ForkServer]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uncaught", {.fqbn = "arduino:avr:nano"}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::ForkServer fs{sk};
+    REQUIRE(fs.valid());
+    std::promise<int> ex;
+    smce::Board br{[&](int ec) { ex.set_value(ec); }};
+    REQUIRE(br.configure({}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.attach_fork_server(&fs));
+    REQUIRE(br.start());
+    auto exfut = ex.get_future();
+    int ticks = 0;
+    while (ticks++ < 5 && exfut.wait_for(0ms) != std::future_status::ready) {
+        exfut.wait_for(1s);
+        br.tick();
+    }
+    REQUIRE(exfut.wait_for(0ms) == std::future_status::ready);
+    REQUIRE(exfut.get() != 0);
+}
+
+#endif
+
+TEST_CASE("In-process execution", "[InProcess]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uart", {.fqbn = "arduino:avr:nano", .in_process = true}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+
+    const auto echo = [](smce::Board& br) {
+        auto uart0 = br.view().uart_channels[0];
+        std::array out = {'I', 'N', 'P', 'R'};
+        std::array<char, out.size()> in{};
+        uart0.rx().write(out);
+        int ticks = 16'000;
+        do {
+            if (ticks-- == 0)
+                return false;
+            uart0.tx().wait_readable(1ms);
+        } while (uart0.tx().read(in) != in.size());
+        return in == out;
+    };
+
+    std::array<smce::Board, 2> boards;
+    for (auto& br : boards) {
+        REQUIRE(br.configure({.uart_channels = {{}}}));
+        REQUIRE(br.attach_sketch(sk));
+        REQUIRE(br.start());
+    }
+    for (auto& br : boards)
+        REQUIRE(echo(br));
+
+    auto& br = boards[0];
+    REQUIRE(br.suspend());
+    REQUIRE(br.resume());
+    REQUIRE(echo(br));
+    REQUIRE(br.stop());
+    REQUIRE(br.status() == smce::Board::Status::stopped);
+    REQUIRE(br.start());
+    REQUIRE(echo(br));
+    REQUIRE(echo(boards[1]));
+}
+
+TEST_CASE("In-process helper threads", "[InProcess]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "helper_thread", {.fqbn = "arduino:avr:nano", .in_process = true}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    REQUIRE(br.configure({.uart_channels = {{}}}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    // Printed from a thread the sketch spawned, which gets the view of the sole in-process board
+    auto uart0 = br.view().uart_channels[0];
+    std::string received;
+    int ticks = 16'000;
+    while (received.size() < 6) {
+        if (ticks-- == 0)
+            FAIL();
+        uart0.tx().wait_readable(1ms);
+        std::array<char, 8> buf;
+        received.append(buf.data(), uart0.tx().read(buf));
+    }
+    REQUIRE(received == "HELPER");
+    REQUIRE(br.stop());
+}
+
+TEST_CASE("In-process abandonment", "[InProcess]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "stubborn", {.fqbn = "arduino:avr:nano", .in_process = true}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    smce::Board br{};
+    REQUIRE(br.configure({.uart_channels = {{}}}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto uart0 = br.view().uart_channels[0];
+    REQUIRE(uart0.tx().wait_readable(16s));
+    // The sketch spins for longer than it gets to yield, so that it is left running on its own
     REQUIRE(br.stop());
+    REQUIRE(br.status() == smce::Board::Status::stopped);
+    REQUIRE(br.runtime_log().copy().find("abandoned") != std::string::npos);
+}
+
+TEST_CASE("In-process exit_notify", "[InProcess]") {
+    smce::Toolchain tc{SMCE_PATH};
+    REQUIRE(!tc.check_suitable_environment());
+    smce::Sketch sk{SKETCHES_PATH "uncaught", {.fqbn = "arduino:avr:nano", .in_process = true}};
+    const auto ec = tc.compile(sk);
+    if (ec)
+        std::cerr << tc.build_log().second;
+    REQUIRE_FALSE(ec);
+    std::promise<int> ex;
+    smce::Board br{[&](int ec) { ex.set_value(ec); }};
+    REQUIRE(br.configure({}));
+    REQUIRE(br.attach_sketch(sk));
+    REQUIRE(br.start());
+    auto exfut = ex.get_future();
+    int ticks = 0;
+    while (ticks++ < 5 && exfut.wait_for(0ms) != std::future_status::ready) {
+        exfut.wait_for(1s);
+        br.tick();
+    }
+    REQUIRE(exfut.wait_for(0ms) == std::future_status::ready);
+    REQUIRE(exfut.get() != 0);
 }
 
 TEST_CASE("Mixed INO/C++ sources", "[BoardRunner]") {
@@ -329,7 +1355,7 @@ TEST_CASE("SD polyfill", "[SD File]") {
     auto d0 = br.view().pins[0].digital();
     test_pin_delayable(d0, true, 16384, 1ms); // wait for the pin to be set
     REQUIRE(br.stop());
-    std::cerr << br.runtime_log().second << std::endl;
+    std::cerr << br.runtime_log().copy() << std::endl;
 
     REQUIRE(std::filesystem::exists(STORAGE_PATH "foo"));
     REQUIRE(std::filesystem::is_directory(STORAGE_PATH "foo"));
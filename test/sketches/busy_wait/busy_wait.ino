@@ -0,0 +1,9 @@
+void setup() {
+    Serial.begin(9600);
+    Serial.print("BUSY");
+}
+
+void loop() {
+    const unsigned long start = millis();
+    while (millis() - start < 60000) {}
+}
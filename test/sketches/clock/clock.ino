@@ -0,0 +1,8 @@
+void setup() {
+    Serial.begin(9600);
+}
+
+void loop() {
+    delay(10000);
+    Serial.println(millis());
+}
@@ -0,0 +1,8 @@
+#include <thread>
+
+void setup() {
+    Serial.begin(9600);
+    std::thread{[] { Serial.print("HELPER"); }}.join();
+}
+
+void loop() { delay(1); }
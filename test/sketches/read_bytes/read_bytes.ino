@@ -0,0 +1,10 @@
+void setup() {
+    Serial.begin(9600);
+    Serial.setTimeout(5000);
+}
+
+void loop() {
+    char buf[8];
+    const size_t count = Serial.readBytes(buf, sizeof(buf));
+    Serial.write(buf, count);
+}
@@ -0,0 +1,9 @@
+void setup() {
+    Serial.begin(9600);
+    Serial.print("STUBBORN");
+}
+
+void loop() {
+    const unsigned long start = millis();
+    while (millis() - start < 3000) {}
+}